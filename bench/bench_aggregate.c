@@ -0,0 +1,169 @@
+// Microbenchmark of per-user score aggregation: the original calculate_score
+// loop (fread one Treasure at a time, strcmp against every known user) versus
+// the column kernels of treasure_aggregate.c on the same synthetic data.
+//
+//   gcc -std=gnu17 -O2 -o bench_aggregate bench/bench_aggregate.c treasure_aggregate.c
+//   ./bench_aggregate [records] [users] [--clustered]
+//
+// --clustered stores each user's treasures in runs of 64, the layout batch
+// loads produce, where whole vectors share one user ID.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../treasure.h"
+#include "../treasure_aggregate.h"
+
+#ifndef BENCH_BUILD_TYPE
+#define BENCH_BUILD_TYPE "unknown" // built outside CMake
+#endif
+
+#define DEFAULT_RECORDS 4000000
+#define DEFAULT_USERS 100
+#define RUN_LENGTH 64
+#define REPEATS 5
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// The scoring loop calculate_score shipped with, minus its 100-user cap.
+// Returns the grand total so results can be cross-checked.
+static long long score_rows(const char *path, size_t users) {
+    typedef struct {
+        char name[MAX_NAME_LEN];
+        long long total;
+    } UserScore;
+
+    FILE *file = fopen(path, "rb");
+    UserScore *scores = calloc(users, sizeof(UserScore));
+    if (!file || !scores) {
+        perror("score_rows");
+        exit(1);
+    }
+    size_t num_users = 0;
+
+    Treasure treasure;
+    while (fread(&treasure, sizeof(Treasure), 1, file) == 1) {
+        int found = 0;
+        for (size_t i = 0; i < num_users; i++) {
+            if (strcmp(scores[i].name, treasure.user) == 0) {
+                scores[i].total += treasure.value;
+                found = 1;
+                break;
+            }
+        }
+        if (!found && num_users < users) {
+            strcpy(scores[num_users].name, treasure.user);
+            scores[num_users].total = treasure.value;
+            num_users++;
+        }
+    }
+    fclose(file);
+
+    long long total = 0;
+    for (size_t i = 0; i < num_users; i++) {
+        total += scores[i].total;
+    }
+    free(scores);
+    return total;
+}
+
+int main(int argc, char *argv[]) {
+    size_t records = DEFAULT_RECORDS;
+    size_t users = DEFAULT_USERS;
+    int clustered = 0;
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--clustered") == 0) {
+            clustered = 1;
+        } else if (positional++ == 0) {
+            records = strtoull(argv[i], NULL, 10);
+        } else {
+            users = strtoull(argv[i], NULL, 10);
+        }
+    }
+    if (records == 0 || users == 0) {
+        fprintf(stderr, "Usage: %s [records] [users] [--clustered]\n", argv[0]);
+        return 1;
+    }
+
+    uint32_t *user = malloc(records * sizeof(uint32_t));
+    int32_t *value = malloc(records * sizeof(int32_t));
+    UserAggregate *out = malloc(users * sizeof(UserAggregate));
+    if (!user || !value || !out) {
+        perror("malloc");
+        return 1;
+    }
+
+    // The same data as a legacy treasures file and as columns
+    char path[] = "/tmp/bench_aggregate.XXXXXX";
+    int fd = mkstemp(path);
+    FILE *file = fd == -1 ? NULL : fdopen(fd, "wb");
+    if (!file) {
+        perror("mkstemp");
+        return 1;
+    }
+
+    srand(42);
+    Treasure treasure;
+    memset(&treasure, 0, sizeof(treasure));
+    for (size_t r = 0; r < records; r++) {
+        user[r] = clustered ? (r / RUN_LENGTH) % users : (size_t)rand() % users;
+        value[r] = rand() % 1000 - 100;
+
+        snprintf(treasure.id, MAX_ID_LEN, "t%zu", r);
+        snprintf(treasure.user, MAX_NAME_LEN, "user%u", user[r]);
+        treasure.value = value[r];
+        fwrite(&treasure, sizeof(treasure), 1, file);
+    }
+    fclose(file);
+
+    printf("%zu records, %zu users, %s layout, %s build\n", records, users, clustered ? "clustered" : "random",
+           BENCH_BUILD_TYPE);
+
+    double start = now_ms();
+    long long expected = score_rows(path, users);
+    double rows_ms = now_ms() - start;
+    printf("%-22s %9.2f ms %9.1f Mrec/s\n", "fread+strcmp", rows_ms, records / rows_ms / 1000);
+    unlink(path);
+
+    for (AggregateKernel kernel = AGGREGATE_SCALAR; kernel <= AGGREGATE_AVX2; kernel++) {
+        if (!aggregate_kernel_supported(kernel)) {
+            printf("%-22s unsupported on this CPU\n", aggregate_kernel_name(kernel));
+            continue;
+        }
+
+        double best = -1;
+        long long total = 0;
+        for (int repeat = 0; repeat < REPEATS; repeat++) {
+            aggregate_reset(out, users);
+            start = now_ms();
+            aggregate_values(kernel, user, value, records, out, users);
+            double elapsed = now_ms() - start;
+            if (best < 0 || elapsed < best) {
+                best = elapsed;
+            }
+
+            total = 0;
+            for (size_t u = 0; u < users; u++) {
+                total += out[u].sum;
+            }
+        }
+
+        char label[32];
+        snprintf(label, sizeof(label), "columns/%s", aggregate_kernel_name(kernel));
+        printf("%-22s %9.2f ms %9.1f Mrec/s %7.1fx%s\n", label, best, records / best / 1000,
+               rows_ms / best, total == expected ? "" : "  MISMATCH");
+    }
+    printf("%-22s %s\n", "dispatch picks", aggregate_kernel_name(aggregate_kernel(user, records)));
+
+    free(user);
+    free(value);
+    free(out);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+// Writes a synthetic hunt into hunts/ under the working directory, for
+// benchmarking by hand or loading the monitor with a large hunt.
+//
+//   ./bench_generate <hunt_id> <records> [users]
+//
+// Counts accept k and m suffixes: ./bench_generate big 10m
+
+#include <stdio.h>
+#include "bench_hunt.h"
+
+int main(int argc, char *argv[]) {
+    size_t records = argc >= 3 ? bench_parse_count(argv[2]) : 0;
+    size_t users = argc == 4 ? bench_parse_count(argv[3]) : BENCH_DEFAULT_USERS;
+    if (argc < 3 || argc > 4 || records == 0 || users == 0) {
+        fprintf(stderr, "Usage: %s <hunt_id> <records> [users]\n", argv[0]);
+        return 1;
+    }
+
+    if (bench_hunt_generate(argv[1], records, users) == -1) {
+        perror("Failed to generate hunt");
+        return 1;
+    }
+    printf("Generated hunt %s with %zu treasures from %zu users\n", argv[1], records, users);
+    return 0;
+}
\ No newline at end of file
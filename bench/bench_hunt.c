@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "../treasure.h"
+#include "../treasure_file.h"
+#include "bench_hunt.h"
+
+#define CHUNK_RECORDS 65536
+
+// xorshift64: fast, and the same sequence on every platform
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+size_t bench_parse_count(const char *text) {
+    char *end;
+    unsigned long long count = strtoull(text, &end, 10);
+    if (end == text) {
+        return 0;
+    }
+    if (*end == 'k' || *end == 'K') {
+        count *= 1000;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        count *= 1000000;
+        end++;
+    }
+    return *end == '\0' ? count : 0;
+}
+
+void bench_hunt_id(size_t r, char *id) {
+    snprintf(id, MAX_ID_LEN, "t%zu", r);
+}
+
+int bench_hunt_generate(const char *hunt_id, size_t records, size_t users) {
+    char path[MAX_PATH_LEN];
+    snprintf(path, MAX_PATH_LEN, "hunts/%s", hunt_id);
+    if ((mkdir("hunts", 0755) == -1 && errno != EEXIST) || mkdir(path, 0755) == -1) {
+        return -1;
+    }
+
+    Treasure *chunk = calloc(CHUNK_RECORDS, sizeof(Treasure));
+    if (!chunk) {
+        return -1;
+    }
+
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    for (size_t done = 0; done < records;) {
+        size_t count = records - done < CHUNK_RECORDS ? records - done : CHUNK_RECORDS;
+        for (size_t i = 0; i < count; i++) {
+            Treasure *treasure = &chunk[i];
+            uint64_t bits = next_random(&state);
+            bench_hunt_id(done + i, treasure->id);
+            snprintf(treasure->user, MAX_NAME_LEN, "user%zu", (size_t)(bits % users));
+            treasure->latitude = (float)((bits >> 16) % 18000) / 100 - 90;
+            treasure->longitude = (float)((bits >> 32) % 36000) / 100 - 180;
+            treasure->value = (int)((bits >> 48) % 1000);
+            snprintf(treasure->clue, MAX_CLUE_LEN, "clue %zu", done + i);
+        }
+
+        TreasureWrite writes[2];
+        off_t end;
+        int planned = treasure_file_plan_append(hunt_id, chunk, count, writes, NULL, &end);
+        if (planned == -1) {
+            free(chunk);
+            return -1;
+        }
+        int result = treasure_file_apply(hunt_id, writes, planned);
+        treasure_file_free_writes(writes, planned);
+        if (result == -1) {
+            free(chunk);
+            return -1;
+        }
+        done += count;
+    }
+
+    free(chunk);
+    return 0;
+}
\ No newline at end of file
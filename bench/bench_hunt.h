@@ -0,0 +1,25 @@
+#ifndef TREASURE_BENCH_HUNT_H
+#define TREASURE_BENCH_HUNT_H
+
+#include <stddef.h>
+
+// Synthetic hunts for the benchmarks. Record r has ID "t<r>", belongs to
+// user "user<n>" for a pseudo-random n below the user count and has a
+// pseudo-random position and value; the same arguments always produce the
+// same file.
+
+#define BENCH_DEFAULT_USERS 1000
+
+// Writes hunts/<hunt_id>/treasures.dat (relative to the working directory)
+// with records treasures in the default format. The hunt must not exist yet
+// (EEXIST otherwise); its sidecars are left for treasure_manager to build.
+// Returns 0, or -1 with errno set.
+int bench_hunt_generate(const char *hunt_id, size_t records, size_t users);
+
+// Parses a record count such as 1000, 100k or 10m. Returns 0 if invalid.
+size_t bench_parse_count(const char *text);
+
+// Formats the ID of record r into id (MAX_ID_LEN bytes)
+void bench_hunt_id(size_t r, char *id);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,373 @@
+// End-to-end benchmarks of the treasure binaries on synthetic hunts. For each
+// hunt size it times treasure_manager --add, --view, --list and
+// --remove_treasure, calculate_score, and the request/reply round trip
+// treasure_hub makes to treasure_monitor, with replies over the socket and
+// over the shared-memory ring, then prints the results as JSON.
+//
+//   ./bench_suite [--sizes 1k,100k,10m] [--repeats n] [--bin dir] [--out file]
+//
+// Every command runs as its own process, as users run them, so the times
+// include exec and opening the hunt. Binaries are taken from --bin (default:
+// the directory holding bench_suite) and run in a scratch directory that is
+// removed afterwards. The monitor binds the fixed socket path of
+// treasure_protocol.h, so no other monitor should be running.
+//
+// Output:
+//   { "suite": "treasure", "build_type": ..., "timestamp": ..., "repeats": ...,
+//     "results": [ { "records": ..., "operation": ..., "unit": "ms" or "us",
+//                    "samples": ..., "min": ..., "median": ..., "p99": ...,
+//                    "mean": ..., "max": ... }, ... ] }
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ftw.h>
+#include <libgen.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include "../treasure.h"
+#include "../treasure_protocol.h"
+#include "../treasure_ring.h"
+#include "bench_hunt.h"
+
+#ifndef BENCH_BUILD_TYPE
+#define BENCH_BUILD_TYPE "unknown" // built outside CMake
+#endif
+
+#define DEFAULT_SIZES "1k,100k,10m"
+#define DEFAULT_REPEATS 10
+#define ROUND_TRIPS 1000
+#define MAX_SIZES 16
+#define HUNT_ID "bench"
+
+static char bin_dir[MAX_PATH_LEN];
+static int repeats = DEFAULT_REPEATS;
+static FILE *out;
+static int results = 0;
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Runs bin_dir/argv[0] with input on stdin and output discarded; returns
+// its wall time in ms, or -1 if it could not run or failed
+static double run(char *const argv[], const char *input) {
+    char path[MAX_PATH_LEN];
+    snprintf(path, MAX_PATH_LEN, "%s/%s", bin_dir, argv[0]);
+
+    int in[2];
+    if (pipe(in) == -1) {
+        perror("pipe");
+        return -1;
+    }
+
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(in[0]);
+        close(in[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(in[0], STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        close(in[0]);
+        close(in[1]);
+        execv(path, argv);
+        _exit(127);
+    }
+
+    close(in[0]);
+    if (input && write(in[1], input, strlen(input)) == -1) {
+        perror("write");
+    }
+    close(in[1]);
+
+    int status;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+    }
+    double elapsed = now_ms() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s %s failed\n", argv[0], argv[1] ? argv[1] : "");
+        return -1;
+    }
+    return elapsed;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Prints one result object; failed runs (negative samples) are left out
+static void report(size_t records, const char *operation, const char *unit, double *samples, size_t count) {
+    size_t valid = 0;
+    double sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (samples[i] >= 0) {
+            samples[valid++] = samples[i];
+            sum += samples[i];
+        }
+    }
+    if (valid == 0) {
+        fprintf(stderr, "%zu records: no successful %s runs\n", records, operation);
+        return;
+    }
+    qsort(samples, valid, sizeof(double), compare_doubles);
+
+    fprintf(out, "%s    { \"records\": %zu, \"operation\": \"%s\", \"unit\": \"%s\", \"samples\": %zu, "
+                 "\"min\": %.3f, \"median\": %.3f, \"p99\": %.3f, \"mean\": %.3f, \"max\": %.3f }",
+            results++ ? ",\n" : "", records, operation, unit, valid, samples[0], samples[valid / 2],
+            samples[(valid * 99) / 100], sum / valid, samples[valid - 1]);
+    fflush(out);
+}
+
+// Waits for the end of the reply to the last request, from ring if set
+static int await_reply(int fd, Ring *ring) {
+    FrameHeader header;
+    int done = 0;
+    if (ring) {
+        RingSlice slices[2];
+        while (!done && ring_recv_frame(ring, &header, slices, fd) == 1) {
+            done = header.flags & FRAME_END;
+            ring_consume(ring, &header);
+        }
+    } else {
+        char *payload;
+        while (!done && frame_recv(fd, &header, &payload) == 1) {
+            done = header.flags & FRAME_END;
+            free(payload);
+        }
+    }
+    return done;
+}
+
+// Times request/reply pairs over one monitor connection, the way the hub
+// sends a command and waits for its FRAME_END
+static void bench_round_trip(size_t records, int use_ring, double *samples) {
+    for (int i = 0; i < ROUND_TRIPS; i++) {
+        samples[i] = -1; // left out of the report unless measured
+    }
+    char monitor[MAX_PATH_LEN];
+    snprintf(monitor, MAX_PATH_LEN, "%s/treasure_monitor", bin_dir);
+
+    unlink(MONITOR_SOCKET);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return;
+    }
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        execl(monitor, "treasure_monitor", NULL);
+        _exit(127);
+    }
+
+    int fd = protocol_connect(MONITOR_SOCKET, 5000);
+    Ring *ring = NULL;
+    if (fd == -1) {
+        perror("Failed to connect to monitor");
+    } else if (use_ring && !(ring = ring_connect(fd, ROUND_TRIPS + 1))) {
+        perror("Failed to attach ring");
+        close(fd);
+    } else {
+        uint64_t state = records;
+        // The first request loads the hunt into the monitor's cache
+        for (int i = -1; i < ROUND_TRIPS; i++) {
+            char cmd[64];
+            char id[MAX_ID_LEN];
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            bench_hunt_id((state >> 33) % records, id);
+            snprintf(cmd, sizeof(cmd), "view_treasure %s %s", HUNT_ID, id);
+
+            double start = now_ms();
+            if (frame_send(fd, i + 1, 0, cmd, strlen(cmd)) == -1) {
+                perror("frame_send");
+                break;
+            }
+            if (!await_reply(fd, ring)) {
+                fprintf(stderr, "Monitor closed the connection\n");
+                break;
+            }
+            if (i >= 0) {
+                samples[i] = (now_ms() - start) * 1000;
+            }
+        }
+        ring_destroy(ring);
+        close(fd);
+    }
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+static void bench_size(size_t records) {
+    double *samples = malloc((repeats > ROUND_TRIPS ? repeats : ROUND_TRIPS) * sizeof(double));
+    if (!samples) {
+        perror("malloc");
+        return;
+    }
+
+    double start = now_ms();
+    if (bench_hunt_generate(HUNT_ID, records, BENCH_DEFAULT_USERS) == -1) {
+        perror("Failed to generate hunt");
+        free(samples);
+        return;
+    }
+    samples[0] = now_ms() - start;
+    report(records, "generate", "ms", samples, 1);
+
+    char id[MAX_ID_LEN];
+    char *view[] = { "treasure_manager", "--view", HUNT_ID, id, NULL };
+
+    // The first command builds the index and other sidecars
+    bench_hunt_id(0, id);
+    samples[0] = run(view, NULL);
+    report(records, "open_cold", "ms", samples, 1);
+
+    for (int i = 0; i < repeats; i++) {
+        char input[128];
+        snprintf(input, sizeof(input), "added%d\nbench\n45.5\n25.5\nadded by bench_suite\n%d\n", i, i);
+        char *add[] = { "treasure_manager", "--add", HUNT_ID, NULL };
+        samples[i] = run(add, input);
+    }
+    report(records, "add", "ms", samples, repeats);
+
+    for (int i = 0; i < repeats; i++) {
+        bench_hunt_id((size_t)i * 7919 % records, id);
+        samples[i] = run(view, NULL);
+    }
+    report(records, "view", "ms", samples, repeats);
+
+    char *list[] = { "treasure_manager", "--list", HUNT_ID, NULL };
+    for (int i = 0; i < repeats; i++) {
+        samples[i] = run(list, NULL);
+    }
+    report(records, "list", "ms", samples, repeats);
+
+    char *score[] = { "calculate_score", HUNT_ID, NULL };
+    for (int i = 0; i < repeats; i++) {
+        samples[i] = run(score, NULL);
+    }
+    report(records, "score", "ms", samples, repeats);
+
+    bench_round_trip(records, 0, samples);
+    report(records, "monitor_round_trip", "us", samples, ROUND_TRIPS);
+    bench_round_trip(records, 1, samples);
+    report(records, "monitor_round_trip_ring", "us", samples, ROUND_TRIPS);
+
+    // Last, as it changes the hunt: distinct records spread over the file
+    char *remove[] = { "treasure_manager", "--remove_treasure", HUNT_ID, id, NULL };
+    size_t stride = records / repeats > 0 ? records / repeats : 1;
+    for (int i = 0; i < repeats; i++) {
+        bench_hunt_id((size_t)i * stride % records, id);
+        samples[i] = run(remove, NULL);
+    }
+    report(records, "remove", "ms", samples, repeats);
+
+    free(samples);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+int main(int argc, char *argv[]) {
+    const char *sizes_arg = DEFAULT_SIZES;
+    const char *out_path = NULL;
+    bin_dir[0] = '\0';
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            sizes_arg = argv[++i];
+        } else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc) {
+            repeats = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bin") == 0 && i + 1 < argc) {
+            if (!realpath(argv[++i], bin_dir)) {
+                perror(argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            repeats = 0;
+            break;
+        }
+    }
+
+    size_t sizes[MAX_SIZES];
+    int num_sizes = 0;
+    char sizes_copy[MAX_PATH_LEN];
+    snprintf(sizes_copy, MAX_PATH_LEN, "%s", sizes_arg);
+    for (char *save, *token = strtok_r(sizes_copy, ",", &save); token && num_sizes < MAX_SIZES;
+         token = strtok_r(NULL, ",", &save)) {
+        if ((sizes[num_sizes++] = bench_parse_count(token)) == 0) {
+            repeats = 0;
+        }
+    }
+    if (repeats <= 0 || num_sizes == 0) {
+        fprintf(stderr, "Usage: %s [--sizes 1k,100k,10m] [--repeats n] [--bin dir] [--out file]\n", argv[0]);
+        return 1;
+    }
+
+    if (bin_dir[0] == '\0') {
+        ssize_t length = readlink("/proc/self/exe", bin_dir, MAX_PATH_LEN - 1);
+        if (length == -1) {
+            perror("readlink");
+            return 1;
+        }
+        bin_dir[length] = '\0';
+        char *dir = dirname(bin_dir);
+        memmove(bin_dir, dir, strlen(dir) + 1);
+    }
+
+    out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+
+    char work_dir[] = "/tmp/treasure_bench.XXXXXX";
+    if (!mkdtemp(work_dir) || chdir(work_dir) == -1) {
+        perror("Failed to create scratch directory");
+        return 1;
+    }
+
+    fprintf(out, "{\n  \"suite\": \"treasure\",\n  \"build_type\": \"%s\",\n  \"timestamp\": %lld,\n"
+                 "  \"repeats\": %d,\n  \"results\": [\n",
+            BENCH_BUILD_TYPE, (long long)time(NULL), repeats);
+    for (int i = 0; i < num_sizes; i++) {
+        fprintf(stderr, "Benchmarking %zu records\n", sizes[i]);
+        bench_size(sizes[i]);
+
+        // Each size starts from an empty directory
+        nftw("hunts", remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        char link_path[MAX_PATH_LEN];
+        snprintf(link_path, MAX_PATH_LEN, "logged_hunt-%s", HUNT_ID);
+        unlink(link_path);
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (chdir("/") == 0) {
+        nftw(work_dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
\ No newline at end of file
@@ -1,69 +1,105 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
 #include "treasure.h"
+#include "treasure_score.h"
+#include "treasure_scorer.h"
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <hunt_id>\n", argv[0]);
-        return 1;
-    }
+// Worker mode: scores the hunts treasure_hub sends over the socket on stdin,
+// one ScorerRequest at a time, until the hub closes it
+static int serve_requests(int result_fd) {
+    ScorerRequest request;
+    ssize_t bytes;
+    while ((bytes = recv(STDIN_FILENO, &request, sizeof(request), 0)) != 0) {
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to read request");
+            return 1;
+        }
 
-    char filename[256];
-    snprintf(filename, sizeof(filename), "hunts/%s/treasures.dat", argv[1]);
+        // An empty hunt ID is a ping
+        ScorerReply reply = { 0 };
+        request.hunt_id[MAX_PATH_LEN - 1] = '\0';
+        if (request.hunt_id[0] != '\0') {
+            ScoreTable table;
+            if (score_hunt(request.hunt_id, &table) == -1) {
+                fprintf(stderr, "Error: Could not open treasures file for hunt %s\n", request.hunt_id);
+                reply.status = -1;
+            } else {
+                score_table_rank(&table, request.top > 0 ? request.top : 0);
+                if (score_table_export(&table, result_fd) == -1) {
+                    perror("Failed to write results");
+                    reply.status = -1;
+                }
+                score_table_free(&table);
+            }
+        }
 
-    FILE *file = fopen(filename, "rb");
-    if (!file) {
-        fprintf(stderr, "Error: Could not open treasures file for hunt %s\n", argv[1]);
-        return 1;
+        if (send(STDIN_FILENO, &reply, sizeof(reply), MSG_NOSIGNAL) == -1) {
+            perror("Failed to send reply");
+            return 1;
+        }
     }
+    return 0;
+}
 
-    // Create a structure to store user scores
-    typedef struct {
-        char name[MAX_NAME_LEN];
-        int total;
-    } UserScore;
-
-    UserScore scores[100];
-    int num_users = 0;
-
-    Treasure treasure;
-    while (fread(&treasure, sizeof(Treasure), 1, file) == 1) {
-        int found = 0;
-        for (int i = 0; i < num_users; i++) {
-            if (strcmp(scores[i].name, treasure.user) == 0) {
-                scores[i].total += treasure.value;
-                found = 1;
-                break;
-            }
+int main(int argc, char *argv[]) {
+    const char *program = argv[0];
+    long top = 0;
+    int result_fd = -1;
+    int worker = 0;
+    while (argc >= 2) {
+        if (strcmp(argv[1], "--worker") == 0) {
+            worker = 1;
+            argv++;
+            argc--;
+            continue;
         }
-
-        if (!found && num_users < 100) {
-            strcpy(scores[num_users].name, treasure.user);
-            scores[num_users].total = treasure.value;
-            num_users++;
+        if (argc < 3 || (strcmp(argv[1], "--top") != 0 && strcmp(argv[1], "--result-fd") != 0)) {
+            break;
+        }
+        if (strcmp(argv[1], "--top") == 0) {
+            top = strtol(argv[2], NULL, 10);
+        } else {
+            result_fd = strtol(argv[2], NULL, 10);
         }
+        argv += 2;
+        argc -= 2;
     }
 
-    fclose(file);
+    if (worker && argc == 1 && result_fd >= 0) {
+        return serve_requests(result_fd);
+    }
+    if (worker || argc != 2 || top < 0) {
+        fprintf(stderr, "Usage: %s [--top <k>] [--result-fd <fd>] <hunt_id>\n", program);
+        fprintf(stderr, "       %s --worker --result-fd <fd>\n", program);
+        return 1;
+    }
 
-    // Sort scores in descending order
-    for (int i = 0; i < num_users - 1; i++) {
-        for (int j = i + 1; j < num_users; j++) {
-            if (scores[i].total < scores[j].total) {
-                UserScore temp = scores[i];
-                scores[i] = scores[j];
-                scores[j] = temp;
-            }
-        }
+    ScoreTable table;
+    if (score_hunt(argv[1], &table) == -1) {
+        fprintf(stderr, "Error: Could not open treasures file for hunt %s\n", argv[1]);
+        return 1;
     }
 
-    // Print results
-    printf("=== Scores for Hunt %s ===\n", argv[1]);
-    for (int i = 0; i < num_users; i++) {
-        printf("%s: %d points\n", scores[i].name, scores[i].total);
+    // Rank and print results, or hand them over in binary for the caller
+    // (treasure_hub) to render
+    score_table_rank(&table, top);
+    int result = 0;
+    if (result_fd >= 0) {
+        if (score_table_export(&table, result_fd) == -1) {
+            perror("Failed to write results");
+            result = 1;
+        }
+    } else {
+        score_table_print(argv[1], &table, stdout);
     }
+    score_table_free(&table);
 
-    return 0;
+    return result;
 }
\ No newline at end of file
@@ -1,78 +1,107 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <time.h>
-
-// Constants
-#define MAX_NAME_LEN 50
-#define MAX_CLUE_LEN 200
-#define MAX_ID_LEN 20
-#define MAX_PATH_LEN 256
-
-// Treasure structure
-typedef struct {
-    char id[MAX_ID_LEN];
-    char user[MAX_NAME_LEN];
-    float latitude;
-    float longitude;
-    char clue[MAX_CLUE_LEN];
-    int value;
-} Treasure;
+#include <stdint.h>
+#include "treasure.h"
+#include "treasure_index.h"
+#include "treasure_map.h"
+#include "treasure_file.h"
+#include "treasure_columns.h"
+#include "treasure_geo.h"
+#include "treasure_batch.h"
+#include "treasure_log.h"
+#include "treasure_lock.h"
+#include "treasure_wal.h"
+#include "treasure_catalog.h"
+#include "treasure_users.h"
+
+#define DEFAULT_COMPACT_RATIO 0.5
 
 // Function prototypes
 void print_usage();
+// The hunt's operation log, opened on first use and kept open until exit
+OpLog *hunt_log = NULL;
+int hunt_created = 0;
+// The hunt's lock, held until exit so log entries are written under it too
+int lock_fd = -1;
+// The hunt's journal, open while a writer holds the lock
+Wal *hunt_wal = NULL;
+
 void log_operation(const char *hunt_id, const char *operation) {
-    // Create hunt directory if it doesn't exist
-    char dir_path[MAX_PATH_LEN];
-    snprintf(dir_path, MAX_PATH_LEN, "hunts/%s", hunt_id);
-    mkdir("hunts", 0777); // Create hunts directory if it doesn't exist
-    mkdir(dir_path, 0777); // Create hunt directory if it doesn't exist
+    if (!hunt_log) {
+        hunt_log = oplog_open(hunt_id, hunt_created);
+        if (!hunt_log) {
+            return;
+        }
+    }
+    oplog_append(hunt_log, operation);
+}
 
-    // Open or create log file
-    char log_path[MAX_PATH_LEN];
-    snprintf(log_path, MAX_PATH_LEN, "%s/logged_hunt", dir_path);
-    FILE *log_file = fopen(log_path, "a");
-    if (!log_file) {
-        perror("Failed to open log file");
-        return;
+void close_log() {
+    if (hunt_log) {
+        oplog_close(hunt_log);
+        hunt_log = NULL;
     }
+}
 
-    // Get current time
-    time_t now = time(NULL);
-    char *time_str = ctime(&now);
-    time_str[strlen(time_str)-1] = '\0'; // Remove newline
+// Converts the held hunt lock, retrying when a signal interrupts the wait.
+// Returns 0 or -1.
+int relock_hunt(int operation) {
+    int result;
+    while ((result = flock(lock_fd, operation)) == -1 && errno == EINTR) {
+    }
+    return result;
+}
 
-    // Write log entry
-    fprintf(log_file, "[%s] %s\n", time_str, operation);
-    fclose(log_file);
+// Takes the hunt's lock for the rest of the command. Writers also open the
+// journal, which replays whatever a crash left unapplied; readers only do so
+// when there is something to replay, upgrading their lock meanwhile.
+// Returns 0, or -1 when the hunt cannot be locked or its journal opened.
+int lock_hunt(const char *hunt_id, int operation) {
+    lock_fd = hunt_lock(hunt_id, operation);
+    if (lock_fd == -1) {
+        return -1;
+    }
+    if (operation == LOCK_SH && !wal_pending(hunt_id)) {
+        return 0;
+    }
+    // Replaying and rebuilding the sidecars need the lock to ourselves
+    if (operation == LOCK_SH && relock_hunt(LOCK_EX) == -1) {
+        return -1;
+    }
 
-    // Create symbolic link (Windows uses junctions which are different)
-    // For Windows, we'll create a hard link instead
-    char link_path[MAX_PATH_LEN];
-    snprintf(link_path, MAX_PATH_LEN, "logged_hunt-%s", hunt_id);
-    remove(link_path); // Remove existing link if any
-    if (link(log_path, link_path) != 0) {
-        perror("Failed to create link");
+    size_t replayed;
+    hunt_wal = wal_open(hunt_id, &replayed);
+    if (hunt_wal && replayed > 0) {
+        // The sidecars may describe the file as it was before the replay
+        index_rebuild(hunt_id);
+        columns_rebuild(hunt_id);
+        geo_rebuild(hunt_id);
+        catalog_refresh(hunt_id);
+        wal_mark_applied(hunt_wal);
+    }
+
+    if (operation == LOCK_SH) {
+        if (hunt_wal) {
+            wal_close(hunt_wal);
+            hunt_wal = NULL;
+        }
+        return relock_hunt(LOCK_SH);
     }
+    return hunt_wal ? 0 : -1;
 }
+
 void add_treasure(const char *hunt_id) {
     // Create hunt directory if it doesn't exist
     char dir_path[MAX_PATH_LEN];
     snprintf(dir_path, MAX_PATH_LEN, "hunts/%s", hunt_id);
     mkdir("hunts", 0777);
-    mkdir(dir_path, 0777);
-
-    // Open or create treasure file
-    char file_path[MAX_PATH_LEN];
-    snprintf(file_path, MAX_PATH_LEN, "%s/treasures.dat", dir_path);
-    int fd = open(file_path, O_WRONLY | O_CREAT | O_APPEND, 0666);
-    if (fd == -1) {
-        perror("Failed to open treasure file");
-        return;
-    }
+    hunt_created = mkdir(dir_path, 0777) == 0;
 
     // Get treasure details from user
     Treasure treasure;
@@ -89,11 +118,29 @@ void add_treasure(const char *hunt_id) {
     printf("Enter value: ");
     scanf("%d", &treasure.value);
 
-    // Write to file
-    if (write(fd, &treasure, sizeof(Treasure)) == -1) {
+    // Lock only once the input is in, so a slow typist holds up nobody
+    if (lock_hunt(hunt_id, LOCK_EX) == -1) {
+        perror("Failed to lock hunt");
+        return;
+    }
+
+    // Append to the treasure file, creating it in the default format, once
+    // the write is safe in the journal
+    TreasureWrite writes[2];
+    off_t offset;
+    off_t end;
+    int planned = treasure_file_plan_append(hunt_id, &treasure, 1, writes, &offset, &end);
+    // The owner's index comes first, so it never misses a committed treasure
+    if (planned == -1 || user_index_add(hunt_id, &treasure, &offset, 1) == -1 ||
+        wal_commit(hunt_wal, WAL_ADD, writes, planned) == -1 || wal_apply(hunt_wal, writes, planned) == -1) {
         perror("Failed to write treasure");
     } else {
         printf("Treasure added successfully!\n");
+        index_add(hunt_id, treasure.id, offset, end);
+        columns_append(hunt_id, &treasure, &offset, 1, end);
+        geo_add(hunt_id, &treasure, &offset, 1, end);
+        catalog_update(hunt_id, writes[0].offset, end, 1, 1, treasure.value);
+        wal_mark_applied(hunt_wal);
 
         // Log the operation
         char log_msg[512];
@@ -101,7 +148,119 @@ void add_treasure(const char *hunt_id) {
         log_operation(hunt_id, log_msg);
     }
 
-    close(fd);
+    if (planned > 0) {
+        treasure_file_free_writes(writes, planned);
+    }
+}
+// Reads treasures from a file (or stdin for "-"), one CSV or JSON record per
+// line. The batch is all-or-nothing: every line is validated before any record
+// is written, then all records are appended with a single write.
+void add_treasure_batch(const char *hunt_id, const char *source) {
+    FILE *input = strcmp(source, "-") == 0 ? stdin : fopen(source, "r");
+    if (!input) {
+        perror("Failed to open batch file");
+        return;
+    }
+
+    Treasure *batch = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t line_number = 0;
+    int errors = 0;
+
+    char *line = NULL;
+    size_t line_size = 0;
+    while (getline(&line, &line_size, input) != -1) {
+        line_number++;
+
+        Treasure treasure;
+        const char *error;
+        int result = batch_parse_line(line, line_number == 1, &treasure, &error);
+        if (result == -1) {
+            fprintf(stderr, "Line %zu: %s\n", line_number, error);
+            errors++;
+            continue;
+        }
+        if (result == 0) {
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            Treasure *grown = realloc(batch, capacity * sizeof(Treasure));
+            if (!grown) {
+                perror("Failed to allocate batch");
+                errors++;
+                break;
+            }
+            batch = grown;
+        }
+        batch[count++] = treasure;
+    }
+
+    free(line);
+    if (input != stdin) {
+        fclose(input);
+    }
+
+    if (errors > 0) {
+        printf("Batch rejected: %d invalid line(s), no treasures were added.\n", errors);
+        free(batch);
+        return;
+    }
+    if (count == 0) {
+        printf("No treasures to add.\n");
+        free(batch);
+        return;
+    }
+
+    char dir_path[MAX_PATH_LEN];
+    snprintf(dir_path, MAX_PATH_LEN, "hunts/%s", hunt_id);
+    mkdir("hunts", 0777);
+    hunt_created = mkdir(dir_path, 0777) == 0;
+
+    if (lock_hunt(hunt_id, LOCK_EX) == -1) {
+        perror("Failed to lock hunt");
+        free(batch);
+        return;
+    }
+
+    // The whole batch is one journal group, made durable with one sync
+    TreasureWrite writes[2];
+    int planned = -1;
+    off_t *offsets = malloc(count * sizeof(off_t));
+    off_t end;
+    if (!offsets) {
+        perror("Failed to allocate batch");
+    } else if ((planned = treasure_file_plan_append(hunt_id, batch, count, writes, offsets, &end)) == -1 ||
+               user_index_add(hunt_id, batch, offsets, count) == -1 ||
+               wal_commit(hunt_wal, WAL_ADD, writes, planned) == -1 ||
+               wal_apply(hunt_wal, writes, planned) == -1) {
+        perror("Failed to write treasures");
+    } else {
+        index_add_batch(hunt_id, batch, offsets, count, end);
+        columns_append(hunt_id, batch, offsets, count, end);
+        geo_add(hunt_id, batch, offsets, count, end);
+        int64_t value = 0;
+        for (size_t i = 0; i < count; i++) {
+            value += batch[i].value;
+        }
+        catalog_update(hunt_id, writes[0].offset, end, count, count, value);
+        wal_mark_applied(hunt_wal);
+        printf("%zu treasures added successfully!\n", count);
+
+        // One log entry for the whole batch
+        char log_msg[512];
+        snprintf(log_msg, sizeof(log_msg), "ADD_BATCH count=%zu first=%s last=%s",
+                 count, batch[0].id, batch[count - 1].id);
+        log_operation(hunt_id, log_msg);
+    }
+
+    if (planned > 0) {
+        treasure_file_free_writes(writes, planned);
+    }
+    free(offsets);
+    free(batch);
 }
 void list_treasures(const char *hunt_id) {
     char dir_path[MAX_PATH_LEN];
@@ -122,27 +281,30 @@ void list_treasures(const char *hunt_id) {
     printf("File size: %lld bytes\n", (long long)file_stat.st_size);
     printf("Last modified: %s", ctime(&file_stat.st_mtime));
 
-    // Open file for reading
-    int fd = open(file_path, O_RDONLY);
-    if (fd == -1) {
+    // Map file for reading
+    TreasureMap map;
+    if (treasure_map_open(hunt_id, &map) == -1) {
         perror("Failed to open treasure file");
         return;
     }
 
-    // Read and print all treasures
-    Treasure treasure;
+    // Print all treasures
     printf("\nTreasures:\n");
     printf("ID\tUser\tLatitude\tLongitude\tValue\n");
     printf("--------------------------------------------------\n");
 
-    while (read(fd, &treasure, sizeof(Treasure)) == sizeof(Treasure)) {
+    const Treasure *treasure;
+    while ((treasure = treasure_map_next(&map, NULL)) != NULL) {
+        if (!treasure_is_live(treasure)) {
+            continue;
+        }
         printf("%s\t%s\t%.6f\t%.6f\t%d\n",
-               treasure.id, treasure.user,
-               treasure.latitude, treasure.longitude,
-               treasure.value);
+               treasure->id, treasure->user,
+               treasure->latitude, treasure->longitude,
+               treasure->value);
     }
 
-    close(fd);
+    treasure_map_close(&map);
 
     // Log the operation
     char log_msg[256];
@@ -150,114 +312,464 @@ void list_treasures(const char *hunt_id) {
     log_operation(hunt_id, log_msg);
 }
 void view_treasure(const char *hunt_id, const char *treasure_id) {
-    char file_path[MAX_PATH_LEN];
-    snprintf(file_path, MAX_PATH_LEN, "hunts/%s/treasures.dat", hunt_id);
+    TreasureMap map;
+    if (treasure_map_open(hunt_id, &map) == -1) {
+        perror("Failed to open treasure file");
+        return;
+    }
+
+    const Treasure *treasure = index_find(hunt_id, &map, treasure_id, NULL);
+    if (treasure) {
+        printf("\nTreasure Details:\n");
+        printf("ID: %s\n", treasure->id);
+        printf("User: %s\n", treasure->user);
+        printf("Coordinates: %.6f, %.6f\n", treasure->latitude, treasure->longitude);
+        printf("Clue: %s\n", treasure->clue);
+        printf("Value: %d\n", treasure->value);
+    } else {
+        printf("Treasure with ID %s not found.\n", treasure_id);
+    }
+
+    treasure_map_close(&map);
 
-    int fd = open(file_path, O_RDONLY);
-    if (fd == -1) {
+    // Log the operation
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "VIEW treasure_id=%s", treasure_id);
+    log_operation(hunt_id, log_msg);
+}
+// Prints the live treasures behind spatial query matches
+void print_matches(const char *hunt_id, const GeoMatch *matches, size_t count, int show_distance) {
+    TreasureMap map;
+    if (treasure_map_open(hunt_id, &map) == -1) {
         perror("Failed to open treasure file");
         return;
     }
 
-    Treasure treasure;
-    int found = 0;
-
-    while (read(fd, &treasure, sizeof(Treasure)) == sizeof(Treasure)) {
-        if (strcmp(treasure.id, treasure_id) == 0) {
-            found = 1;
-            printf("\nTreasure Details:\n");
-            printf("ID: %s\n", treasure.id);
-            printf("User: %s\n", treasure.user);
-            printf("Coordinates: %.6f, %.6f\n", treasure.latitude, treasure.longitude);
-            printf("Clue: %s\n", treasure.clue);
-            printf("Value: %d\n", treasure.value);
-            break;
+    printf("ID\tUser\tLatitude\tLongitude\tValue%s\n", show_distance ? "\tDistance (km)" : "");
+    printf("--------------------------------------------------\n");
+
+    size_t shown = 0;
+    for (size_t i = 0; i < count; i++) {
+        const Treasure *treasure = treasure_map_at(&map, matches[i].offset);
+        if (!treasure || !treasure_is_live(treasure)) {
+            continue; // removed since the index was built
         }
+        printf("%s\t%s\t%.6f\t%.6f\t%d", treasure->id, treasure->user,
+               treasure->latitude, treasure->longitude, treasure->value);
+        if (show_distance) {
+            printf("\t%.3f", matches[i].distance);
+        }
+        printf("\n");
+        shown++;
     }
+    printf("%zu treasure(s) found.\n", shown);
 
-    if (!found) {
-        printf("Treasure with ID %s not found.\n", treasure_id);
+    treasure_map_close(&map);
+}
+
+// Parses a decimal coordinate or distance argument
+int parse_number(const char *text, double *value) {
+    char *end;
+    *value = strtod(text, &end);
+    return end != text && *end == '\0' ? 0 : -1;
+}
+
+void near_treasures(const char *hunt_id, const char *lat_arg, const char *lon_arg, const char *radius_arg) {
+    double lat, lon, radius;
+    if (parse_number(lat_arg, &lat) == -1 || parse_number(lon_arg, &lon) == -1 ||
+        parse_number(radius_arg, &radius) == -1 || radius < 0) {
+        printf("Invalid coordinates or radius.\n");
+        return;
     }
 
-    close(fd);
+    GeoMatch *matches;
+    size_t count;
+    if (geo_query_near(hunt_id, lat, lon, radius, &matches, &count) == -1) {
+        perror("Failed to query treasures");
+        return;
+    }
+
+    printf("Treasures within %.3f km of %.6f, %.6f in hunt %s:\n", radius, lat, lon, hunt_id);
+    print_matches(hunt_id, matches, count, 1);
+    free(matches);
 
-    // Log the operation
     char log_msg[256];
-    snprintf(log_msg, sizeof(log_msg), "VIEW treasure_id=%s", treasure_id);
+    snprintf(log_msg, sizeof(log_msg), "NEAR lat=%.6f lon=%.6f radius=%.3f", lat, lon, radius);
     log_operation(hunt_id, log_msg);
 }
-void remove_treasure(const char *hunt_id, const char *treasure_id) {
-    char file_path[MAX_PATH_LEN];
-    snprintf(file_path, MAX_PATH_LEN, "hunts/%s/treasures.dat", hunt_id);
 
-    // Open original file
-    int fd = open(file_path, O_RDONLY);
-    if (fd == -1) {
-        perror("Failed to open treasure file");
+void bbox_treasures(const char *hunt_id, char *const bounds[4]) {
+    double min_lat, min_lon, max_lat, max_lon;
+    if (parse_number(bounds[0], &min_lat) == -1 || parse_number(bounds[1], &min_lon) == -1 ||
+        parse_number(bounds[2], &max_lat) == -1 || parse_number(bounds[3], &max_lon) == -1 ||
+        min_lat > max_lat) {
+        printf("Invalid bounding box.\n");
         return;
     }
 
-    // Create temporary file
+    GeoMatch *matches;
+    size_t count;
+    if (geo_query_box(hunt_id, min_lat, min_lon, max_lat, max_lon, &matches, &count) == -1) {
+        perror("Failed to query treasures");
+        return;
+    }
+
+    printf("Treasures in [%.6f, %.6f] - [%.6f, %.6f] in hunt %s:\n", min_lat, min_lon, max_lat, max_lon, hunt_id);
+    print_matches(hunt_id, matches, count, 0);
+    free(matches);
+
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "BBOX min_lat=%.6f min_lon=%.6f max_lat=%.6f max_lon=%.6f",
+             min_lat, min_lon, max_lat, max_lon);
+    log_operation(hunt_id, log_msg);
+}
+// Rewrites treasures.dat without its tombstones, in the default format (so
+// compacting converts legacy hunts). Returns the number of records reclaimed,
+// or -1 on failure.
+long compact_hunt(const char *hunt_id) {
+    // Journaled writes refer to offsets in the file about to be replaced
+    if (!hunt_wal || wal_checkpoint(hunt_wal) == -1) {
+        perror("Failed to checkpoint journal");
+        return -1;
+    }
+
+    TreasureMap map;
+    if (treasure_map_open(hunt_id, &map) == -1) {
+        perror("Failed to open treasure file");
+        return -1;
+    }
+
+    char file_path[MAX_PATH_LEN];
+    snprintf(file_path, MAX_PATH_LEN, "hunts/%s/treasures.dat", hunt_id);
     char temp_path[MAX_PATH_LEN];
-    snprintf(temp_path, MAX_PATH_LEN, "hunts/%s/treasures.tmp", hunt_id);
-    int temp_fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    int temp_fd = temp_file_create(file_path, temp_path);
     if (temp_fd == -1) {
         perror("Failed to create temporary file");
-        close(fd);
-        return;
+        treasure_map_close(&map);
+        return -1;
     }
 
-    Treasure treasure;
-    int found = 0;
-
-    // Copy all treasures except the one to remove
-    while (read(fd, &treasure, sizeof(Treasure)) == sizeof(Treasure)) {
-        if (strcmp(treasure.id, treasure_id) != 0) {
-            write(temp_fd, &treasure, sizeof(Treasure));
-        } else {
-            found = 1;
+    TreasureFormat format = treasure_file_default_format();
+    int ok = format == TREASURE_FORMAT_LEGACY || treasure_file_write_header(temp_fd, 0) == 0;
+    if (ok) {
+        lseek(temp_fd, treasure_file_data_start(format), SEEK_SET);
+    }
+
+    // Re-encode live records into a buffer and write it out in large chunks
+    char buffer[64 * 1024];
+    size_t used = 0;
+    long reclaimed = 0;
+    uint64_t kept = 0;
+    const Treasure *treasure;
+    while (ok && (treasure = treasure_map_next(&map, NULL)) != NULL) {
+        if (!treasure_is_live(treasure)) {
+            reclaimed++;
+            continue;
+        }
+        if (used + COMPACT_MAX_LEN > sizeof(buffer)) {
+            ok = write(temp_fd, buffer, used) == (ssize_t)used;
+            used = 0;
         }
+        used += treasure_file_encode(format, treasure, buffer + used);
+        kept++;
+    }
+    if (ok && used > 0) {
+        ok = write(temp_fd, buffer, used) == (ssize_t)used;
+    }
+    if (ok && format == TREASURE_FORMAT_COMPACT) {
+        ok = treasure_file_write_header(temp_fd, kept) == 0;
     }
 
-    close(fd);
+    treasure_map_close(&map);
     close(temp_fd);
 
-    if (!found) {
-        printf("Treasure with ID %s not found.\n", treasure_id);
+    // A crash leaves either the old file or the complete new one
+    if (!ok) {
         remove(temp_path);
+    }
+    if (!ok || durable_replace(temp_path, file_path) == -1) {
+        perror("Failed to replace treasure file");
+        return -1;
+    }
+
+    index_rebuild(hunt_id);
+    columns_rebuild(hunt_id);
+    geo_rebuild(hunt_id);
+    catalog_refresh(hunt_id);
+    return reclaimed;
+}
+
+void compact_treasures(const char *hunt_id) {
+    long reclaimed = compact_hunt(hunt_id);
+    if (reclaimed == -1) {
         return;
     }
 
-    // Replace original file with temporary file
-    remove(file_path);
-    rename(temp_path, file_path);
+    printf("Hunt %s compacted, %ld removed record(s) reclaimed.\n", hunt_id, reclaimed);
 
-    printf("Treasure %s removed successfully.\n", treasure_id);
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "COMPACT reclaimed=%ld", reclaimed);
+    log_operation(hunt_id, log_msg);
+}
+
+// Compacts in a background child once tombstones make up at least
+// TREASURE_COMPACT_RATIO (default 0.5) of the file. The child inherits the
+// hunt's lock, so no other writer gets in before it is done.
+void maybe_compact(const char *hunt_id) {
+    double ratio = DEFAULT_COMPACT_RATIO;
+    const char *setting = getenv("TREASURE_COMPACT_RATIO");
+    if (setting) {
+        ratio = atof(setting);
+    }
+
+    size_t records;
+    size_t dead;
+    if (ratio <= 0 || index_counts(hunt_id, &records, &dead) == -1 || records == 0 ||
+        (double)dead / records < ratio) {
+        return;
+    }
+
+    // The child must neither inherit queued entries nor use the parent's writer thread
+    if (hunt_log) {
+        oplog_flush(hunt_log);
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        hunt_log = NULL;
+        hunt_created = 0;
+        long reclaimed = compact_hunt(hunt_id);
+        if (reclaimed >= 0) {
+            char log_msg[256];
+            snprintf(log_msg, sizeof(log_msg), "COMPACT reclaimed=%ld automatic", reclaimed);
+            log_operation(hunt_id, log_msg);
+        }
+        close_log();
+        _exit(reclaimed >= 0 ? 0 : 1);
+    }
+}
+
+// A live record that remove_treasure tombstones
+typedef struct {
+    off_t offset;
+    int value;
+    char user[MAX_NAME_LEN];
+} Removal;
+
+// Collects every live record holding treasure_id. The index knows the first;
+// the rest are only looked for when the hunt has duplicate IDs. Returns the
+// number found (*removals is malloc'd when nonzero), or -1.
+ssize_t find_removals(const char *hunt_id, TreasureMap *map, const char *treasure_id, Removal **removals) {
+    *removals = NULL;
+    off_t offset;
+    const Treasure *treasure = index_find(hunt_id, map, treasure_id, &offset);
+    if (!treasure) {
+        return 0;
+    }
+
+    size_t count = 0;
+    size_t capacity = 0;
+    int scan = index_has_duplicates(hunt_id) != 0;
+    if (scan) {
+        map->position = treasure_file_data_start(map->format);
+        treasure = treasure_map_next(map, &offset);
+    }
+    while (treasure) {
+        if (treasure_is_live(treasure) && strcmp(treasure->id, treasure_id) == 0) {
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 4;
+                Removal *grown = realloc(*removals, capacity * sizeof(Removal));
+                if (!grown) {
+                    free(*removals);
+                    *removals = NULL;
+                    return -1;
+                }
+                *removals = grown;
+            }
+            (*removals)[count].offset = offset;
+            (*removals)[count].value = treasure->value;
+            snprintf((*removals)[count].user, MAX_NAME_LEN, "%s", treasure->user);
+            count++;
+        }
+        treasure = scan ? treasure_map_next(map, &offset) : NULL;
+    }
+    return count;
+}
+
+// Removes every live record holding the ID, as the rewrite removal once was
+// did, so no duplicate is left behind where nothing can reach it by ID
+void remove_treasure(const char *hunt_id, const char *treasure_id) {
+    TreasureMap map;
+    if (treasure_map_open(hunt_id, &map) == -1) {
+        perror("Failed to open treasure file");
+        return;
+    }
+
+    Removal *removals;
+    ssize_t count = find_removals(hunt_id, &map, treasure_id, &removals);
+    off_t size = map.length;
+    treasure_map_close(&map);
+    if (count == -1) {
+        perror("Failed to remove treasure");
+        return;
+    }
+    if (count == 0) {
+        printf("Treasure with ID %s not found.\n", treasure_id);
+        return;
+    }
+
+    // Tombstone each record with a single one-byte write, all journaled
+    // first as one group
+    TreasureWrite *writes = malloc(count * sizeof(TreasureWrite));
+    ssize_t planned = 0;
+    while (writes && hunt_wal && planned < count &&
+           treasure_file_plan_tombstone(hunt_id, removals[planned].offset, &writes[planned]) == 0) {
+        planned++;
+    }
+    if (planned < count) {
+        perror("Failed to remove treasure");
+        if (writes) {
+            treasure_file_free_writes(writes, planned);
+        }
+        free(writes);
+        free(removals);
+        return;
+    }
+
+    // The column header cannot tell a tombstone happened, so the rows go
+    // dead before the records do; a crash in between replays the group and
+    // rebuilds the columns
+    int committed = wal_commit(hunt_wal, WAL_REMOVE, writes, count);
+    if (committed == 0) {
+        for (ssize_t i = 0; i < count; i++) {
+            if (columns_remove(hunt_id, removals[i].offset) == -1) {
+                columns_invalidate(hunt_id);
+                break;
+            }
+        }
+        committed = wal_apply(hunt_wal, writes, count);
+    }
+    treasure_file_free_writes(writes, count);
+    free(writes);
+    if (committed == -1) {
+        perror("Failed to remove treasure");
+        free(removals);
+        return;
+    }
+
+    int64_t value = 0;
+    for (ssize_t i = 0; i < count; i++) {
+        value += removals[i].value;
+        user_index_remove(removals[i].user, hunt_id, treasure_id);
+    }
+    index_remove(hunt_id, treasure_id, count);
+    catalog_update(hunt_id, size, size, 0, -count, -value);
+    wal_mark_applied(hunt_wal);
+
+    if (count == 1) {
+        printf("Treasure %s removed successfully.\n", treasure_id);
+    } else {
+        printf("Treasure %s removed successfully (%zd records held the ID).\n", treasure_id, count);
+    }
+
+    // Log the operation, one entry per record so each offset is recorded
+    for (ssize_t i = 0; i < count; i++) {
+        char log_msg[256];
+        snprintf(log_msg, sizeof(log_msg), "REMOVE_TREASURE treasure_id=%s offset=%lld", treasure_id,
+                 (long long)removals[i].offset);
+        log_operation(hunt_id, log_msg);
+    }
+    free(removals);
+
+    maybe_compact(hunt_id);
+}
+// Creates the hunt's column files; later writes keep them in sync
+void build_columns(const char *hunt_id) {
+    if (columns_build(hunt_id) == -1) {
+        perror("Failed to build columns");
+        return;
+    }
+
+    printf("Columns built for hunt %s.\n", hunt_id);
 
-    // Log the operation
     char log_msg[256];
-    snprintf(log_msg, sizeof(log_msg), "REMOVE_TREASURE treasure_id=%s", treasure_id);
+    snprintf(log_msg, sizeof(log_msg), "BUILD_COLUMNS");
     log_operation(hunt_id, log_msg);
 }
+void print_owned(const char *hunt_id, const Treasure *treasure, void *arg) {
+    (void)arg;
+    printf("%s\t%s\t%.6f\t%.6f\t%d\n", hunt_id, treasure->id,
+           treasure->latitude, treasure->longitude, treasure->value);
+}
+
+// Lists a user's treasures in every hunt from the user index, reading only
+// the hunts they own treasures in. Like the monitor, it reads the data
+// files without taking hunt locks.
+void by_user(const char *user) {
+    printf("Treasures of user %s:\n", user);
+    printf("Hunt\tID\tLatitude\tLongitude\tValue\n");
+    printf("--------------------------------------------------\n");
+
+    long found = user_index_find(user, print_owned, NULL);
+    if (found == -1) {
+        perror("Failed to read user index");
+        return;
+    }
+    printf("%ld treasure(s) found.\n", found);
+}
 void remove_hunt(const char *hunt_id) {
     char dir_path[MAX_PATH_LEN];
     snprintf(dir_path, MAX_PATH_LEN, "hunts/%s", hunt_id);
 
+    // The owners' references go while the records still say who they are
+    user_index_drop_hunt(hunt_id);
+
     // First remove the treasure file
     char file_path[MAX_PATH_LEN];
     snprintf(file_path, MAX_PATH_LEN, "%s/treasures.dat", dir_path);
     remove(file_path);
 
+    // Remove the index
+    char index_path[MAX_PATH_LEN];
+    snprintf(index_path, MAX_PATH_LEN, "%s/treasures.idx", dir_path);
+    remove(index_path);
+
+    // Remove the spatial index
+    char geo_path[MAX_PATH_LEN];
+    snprintf(geo_path, MAX_PATH_LEN, "%s/treasures.geo", dir_path);
+    remove(geo_path);
+
+    // Remove the columns, if they were ever built
+    const char *column_files[] = {"user.u32", "value.i32", "lat.f32", "lon.f32", "offset.i64", "users.dict", "meta"};
+    char columns_path[MAX_PATH_LEN];
+    for (size_t i = 0; i < sizeof(column_files) / sizeof(column_files[0]); i++) {
+        snprintf(columns_path, MAX_PATH_LEN, "%s/columns/%s", dir_path, column_files[i]);
+        remove(columns_path);
+    }
+    snprintf(columns_path, MAX_PATH_LEN, "%s/columns", dir_path);
+    rmdir(columns_path);
+
     // Remove the log file
     char log_path[MAX_PATH_LEN];
     snprintf(log_path, MAX_PATH_LEN, "%s/logged_hunt", dir_path);
     remove(log_path);
 
+    // Remove the journal
+    char wal_path[MAX_PATH_LEN];
+    snprintf(wal_path, MAX_PATH_LEN, "%s/treasures.wal", dir_path);
+    remove(wal_path);
+
+    // Writers waiting on the lock notice it is gone and give up
+    char lock_path[MAX_PATH_LEN];
+    snprintf(lock_path, MAX_PATH_LEN, "%s/.lock", dir_path);
+    remove(lock_path);
+
     // Remove the directory
     if (rmdir(dir_path) == -1) {
         perror("Failed to remove hunt directory");
         return;
     }
+    catalog_drop(hunt_id);
 
     // Remove the symbolic link
     char link_path[MAX_PATH_LEN];
@@ -275,30 +787,77 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    // Parse command line arguments
+    // Parse command line arguments. Readers share the hunt's lock and other
+    // writers take it exclusively; adds lock once their input is read. A
+    // hunt that does not exist yet has no lock, and the command reports that.
+    // Removing a hunt needs no journal.
     if (strcmp(argv[1], "--add") == 0 && argc == 3) {
         add_treasure(argv[2]);
+    } else if (strcmp(argv[1], "--add-batch") == 0 && argc == 4) {
+        add_treasure_batch(argv[2], argv[3]);
     } else if (strcmp(argv[1], "--list") == 0 && argc == 3) {
+        lock_hunt(argv[2], LOCK_SH);
         list_treasures(argv[2]);
     } else if (strcmp(argv[1], "--view") == 0 && argc == 4) {
+        lock_hunt(argv[2], LOCK_SH);
         view_treasure(argv[2], argv[3]);
+    } else if (strcmp(argv[1], "--near") == 0 && argc == 6) {
+        lock_hunt(argv[2], LOCK_SH);
+        near_treasures(argv[2], argv[3], argv[4], argv[5]);
+    } else if (strcmp(argv[1], "--bbox") == 0 && argc == 7) {
+        lock_hunt(argv[2], LOCK_SH);
+        bbox_treasures(argv[2], argv + 3);
+    } else if (strcmp(argv[1], "--by-user") == 0 && argc == 3) {
+        by_user(argv[2]);
     } else if (strcmp(argv[1], "--remove_treasure") == 0 && argc == 4) {
+        if (lock_hunt(argv[2], LOCK_EX) == -1) {
+            perror("Failed to lock hunt");
+            return 1;
+        }
         remove_treasure(argv[2], argv[3]);
+    } else if (strcmp(argv[1], "--compact") == 0 && argc == 3) {
+        if (lock_hunt(argv[2], LOCK_EX) == -1) {
+            perror("Failed to lock hunt");
+            return 1;
+        }
+        compact_treasures(argv[2]);
+    } else if (strcmp(argv[1], "--build-columns") == 0 && argc == 3) {
+        if (lock_hunt(argv[2], LOCK_EX) == -1) {
+            perror("Failed to lock hunt");
+            return 1;
+        }
+        build_columns(argv[2]);
     } else if (strcmp(argv[1], "--remove_hunt") == 0 && argc == 3) {
+        lock_fd = hunt_lock(argv[2], LOCK_EX);
+        if (lock_fd == -1) {
+            perror("Failed to lock hunt");
+            return 1;
+        }
         remove_hunt(argv[2]);
     } else {
         print_usage();
         return 1;
     }
 
+    if (hunt_wal) {
+        wal_close(hunt_wal);
+    }
+    close_log();
+    hunt_unlock(lock_fd);
     return 0;
 }
 
 void print_usage() {
     printf("Usage:\n");
     printf("  treasure_manager --add <hunt_id>\n");
+    printf("  treasure_manager --add-batch <hunt_id> <file|->\n");
     printf("  treasure_manager --list <hunt_id>\n");
     printf("  treasure_manager --view <hunt_id> <treasure_id>\n");
+    printf("  treasure_manager --near <hunt_id> <latitude> <longitude> <radius_km>\n");
+    printf("  treasure_manager --bbox <hunt_id> <min_lat> <min_lon> <max_lat> <max_lon>\n");
+    printf("  treasure_manager --by-user <user>\n");
     printf("  treasure_manager --remove_treasure <hunt_id> <treasure_id>\n");
+    printf("  treasure_manager --compact <hunt_id>\n");
+    printf("  treasure_manager --build-columns <hunt_id>\n");
     printf("  treasure_manager --remove_hunt <hunt_id>\n");
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #define MAX_CLUE_LEN 200
 #define MAX_ID_LEN 20
 #define MAX_TREASURE_ID_LEN 20
+#define MAX_PATH_LEN 256
 
 typedef struct {
     char id[MAX_ID_LEN];
@@ -15,4 +16,10 @@ typedef struct {
     int value;
 } Treasure;
 
+// Removing a treasure clears the first byte of its ID in place (a tombstone);
+// the record keeps its slot in treasures.dat until the hunt is compacted.
+static inline int treasure_is_live(const Treasure *treasure) {
+    return treasure->id[0] != '\0';
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include <stdlib.h>
+#include <string.h>
+#include "treasure_aggregate.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+#define AGGREGATE_BANKS 4
+#define BANKED_MAX_USERS 65536 // beyond this the extra banks cost more cache than they save
+#define LAYOUT_SAMPLES 64        // 8-record vectors checked to judge the layout
+#define CLUSTERED_SHARE 2        // clustered when 1 in this many samples is uniform
+
+// Accumulator banks: bank[0] is the caller's output, the rest are scratch
+typedef struct {
+    UserAggregate *bank[AGGREGATE_BANKS];
+    UserAggregate *scratch;
+} Banks;
+
+static inline void fold(UserAggregate *aggregate, int32_t value) {
+    aggregate->sum += value;
+    aggregate->count++;
+    if (value < aggregate->min) {
+        aggregate->min = value;
+    }
+    if (value > aggregate->max) {
+        aggregate->max = value;
+    }
+}
+
+static inline void fold_run(UserAggregate *aggregate, long long sum, uint64_t count, int32_t min, int32_t max) {
+    aggregate->sum += sum;
+    aggregate->count += count;
+    if (min < aggregate->min) {
+        aggregate->min = min;
+    }
+    if (max > aggregate->max) {
+        aggregate->max = max;
+    }
+}
+
+// Falls back to a single bank when the dictionary is large or memory is short
+static void banks_open(Banks *banks, UserAggregate *out, size_t users) {
+    banks->scratch = NULL;
+    if (users <= BANKED_MAX_USERS) {
+        banks->scratch = malloc((AGGREGATE_BANKS - 1) * users * sizeof(UserAggregate));
+    }
+
+    for (int b = 0; b < AGGREGATE_BANKS; b++) {
+        banks->bank[b] = out;
+    }
+    if (banks->scratch) {
+        aggregate_reset(banks->scratch, (AGGREGATE_BANKS - 1) * users);
+        for (int b = 1; b < AGGREGATE_BANKS; b++) {
+            banks->bank[b] = banks->scratch + (b - 1) * users;
+        }
+    }
+}
+
+static void banks_close(Banks *banks, size_t users) {
+    if (!banks->scratch) {
+        return;
+    }
+
+    UserAggregate *out = banks->bank[0];
+    for (int b = 1; b < AGGREGATE_BANKS; b++) {
+        for (size_t u = 0; u < users; u++) {
+            const UserAggregate *from = &banks->bank[b][u];
+            if (from->count > 0) {
+                fold_run(&out[u], from->sum, from->count, from->min, from->max);
+            }
+        }
+    }
+    free(banks->scratch);
+}
+
+// Folds records [start, end) rotating over the banks
+static inline void fold_banked(const Banks *banks, const uint32_t *user, const int32_t *value,
+                               size_t start, size_t end, size_t users) {
+    for (size_t r = start; r < end; r++) {
+        uint32_t id = user[r];
+        if (id < users) {
+            fold(&banks->bank[r % AGGREGATE_BANKS][id], value[r]);
+        }
+    }
+}
+
+static void aggregate_scalar(const uint32_t *user, const int32_t *value, size_t records,
+                             UserAggregate *out, size_t users) {
+    Banks banks;
+    banks_open(&banks, out, users);
+    fold_banked(&banks, user, value, 0, records, users);
+    banks_close(&banks, users);
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// Scalar fold of one mixed vector; lanes keep fixed banks so the loop unrolls
+static inline void fold_lanes(const Banks *banks, const uint32_t *user, const int32_t *value,
+                              int lanes, size_t users) {
+    for (int lane = 0; lane < lanes; lane++) {
+        if (user[lane] < users) {
+            fold(&banks->bank[lane % AGGREGATE_BANKS][user[lane]], value[lane]);
+        }
+    }
+}
+
+__attribute__((target("sse4.1")))
+static inline int32_t min_epi32_sse4(__m128i v) {
+    v = _mm_min_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_min_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+__attribute__((target("sse4.1")))
+static inline int32_t max_epi32_sse4(__m128i v) {
+    v = _mm_max_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_max_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+// Values are widened to 64 bits before adding so the sum cannot overflow
+__attribute__((target("sse4.1")))
+static inline long long sum_epi32_sse4(__m128i v) {
+    __m128i sum = _mm_add_epi64(_mm_cvtepi32_epi64(v), _mm_cvtepi32_epi64(_mm_srli_si128(v, 8)));
+    return _mm_cvtsi128_si64(sum) + _mm_extract_epi64(sum, 1);
+}
+
+__attribute__((target("sse4.1")))
+static void aggregate_sse4(const uint32_t *user, const int32_t *value, size_t records,
+                           UserAggregate *out, size_t users) {
+    Banks banks;
+    banks_open(&banks, out, users);
+
+    size_t r = 0;
+    for (; r + 4 <= records; r += 4) {
+        // Comparing the end lanes first keeps mixed vectors on the cheap path
+        if (user[r] == user[r + 3] && user[r] < users &&
+            _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(user + r)),
+                                              _mm_set1_epi32(user[r]))) == 0xffff) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(value + r));
+            fold_run(&out[user[r]], sum_epi32_sse4(v), 4, min_epi32_sse4(v), max_epi32_sse4(v));
+        } else {
+            fold_lanes(&banks, user + r, value + r, 4, users);
+        }
+    }
+    fold_banked(&banks, user, value, r, records, users);
+
+    banks_close(&banks, users);
+}
+
+__attribute__((target("avx2")))
+static void aggregate_avx2(const uint32_t *user, const int32_t *value, size_t records,
+                           UserAggregate *out, size_t users) {
+    Banks banks;
+    banks_open(&banks, out, users);
+
+    size_t r = 0;
+    for (; r + 8 <= records; r += 8) {
+        if (user[r] == user[r + 7] && user[r] < users &&
+            _mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(user + r)),
+                                                    _mm256_set1_epi32(user[r]))) == -1) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(value + r));
+            __m128i low = _mm256_castsi256_si128(v);
+            __m128i high = _mm256_extracti128_si256(v, 1);
+
+            __m256i wide = _mm256_add_epi64(_mm256_cvtepi32_epi64(low), _mm256_cvtepi32_epi64(high));
+            __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(wide), _mm256_extracti128_si256(wide, 1));
+
+            fold_run(&out[user[r]], _mm_cvtsi128_si64(sum) + _mm_extract_epi64(sum, 1), 8,
+                     min_epi32_sse4(_mm_min_epi32(low, high)), max_epi32_sse4(_mm_max_epi32(low, high)));
+        } else {
+            fold_lanes(&banks, user + r, value + r, 8, users);
+        }
+    }
+    fold_banked(&banks, user, value, r, records, users);
+
+    banks_close(&banks, users);
+}
+
+#endif
+
+int aggregate_kernel_supported(AggregateKernel kernel) {
+    switch (kernel) {
+    case AGGREGATE_SCALAR:
+        return 1;
+#ifdef HAVE_X86_KERNELS
+    case AGGREGATE_SSE4:
+        return __builtin_cpu_supports("sse4.1");
+    case AGGREGATE_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return 0;
+    }
+}
+
+const char *aggregate_kernel_name(AggregateKernel kernel) {
+    switch (kernel) {
+    case AGGREGATE_SSE4:
+        return "sse4";
+    case AGGREGATE_AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+// Whether enough evenly spaced 8-record vectors hold a single user ID for the
+// vector kernels' uniform path to pay for their checks. On random layouts
+// nearly every vector is mixed and the scalar kernel is as fast or faster.
+static int clustered(const uint32_t *user, size_t records) {
+    size_t vectors = records / 8;
+    if (vectors < LAYOUT_SAMPLES) {
+        return 0; // too few records for the kernel to matter
+    }
+
+    int uniform = 0;
+    for (size_t i = 0; i < LAYOUT_SAMPLES; i++) {
+        const uint32_t *v = user + i * (vectors / LAYOUT_SAMPLES) * 8;
+        int same = 1;
+        for (int lane = 1; lane < 8 && same; lane++) {
+            same = v[lane] == v[0];
+        }
+        uniform += same;
+    }
+    return uniform * CLUSTERED_SHARE >= LAYOUT_SAMPLES;
+}
+
+AggregateKernel aggregate_kernel(const uint32_t *user, size_t records) {
+    const char *setting = getenv("TREASURE_KERNEL");
+    if (setting) {
+        for (AggregateKernel k = AGGREGATE_SCALAR; k <= AGGREGATE_AVX2; k++) {
+            if (strcmp(setting, aggregate_kernel_name(k)) == 0 && aggregate_kernel_supported(k)) {
+                return k;
+            }
+        }
+    }
+
+    if (!clustered(user, records)) {
+        return AGGREGATE_SCALAR;
+    }
+    if (aggregate_kernel_supported(AGGREGATE_AVX2)) {
+        return AGGREGATE_AVX2;
+    }
+    if (aggregate_kernel_supported(AGGREGATE_SSE4)) {
+        return AGGREGATE_SSE4;
+    }
+    return AGGREGATE_SCALAR;
+}
+
+void aggregate_reset(UserAggregate *out, size_t users) {
+    for (size_t u = 0; u < users; u++) {
+        out[u].sum = 0;
+        out[u].count = 0;
+        out[u].min = INT32_MAX;
+        out[u].max = INT32_MIN;
+    }
+}
+
+void aggregate_values(AggregateKernel kernel, const uint32_t *user, const int32_t *value, size_t records,
+                      UserAggregate *out, size_t users) {
+    switch (kernel) {
+#ifdef HAVE_X86_KERNELS
+    case AGGREGATE_AVX2:
+        aggregate_avx2(user, value, records, out, users);
+        return;
+    case AGGREGATE_SSE4:
+        aggregate_sse4(user, value, records, out, users);
+        return;
+#endif
+    default:
+        aggregate_scalar(user, value, records, out, users);
+        return;
+    }
+}
\ No newline at end of file
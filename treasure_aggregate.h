@@ -0,0 +1,52 @@
+#ifndef TREASURE_AGGREGATE_H
+#define TREASURE_AGGREGATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-user aggregation of the value column by dictionary-encoded user ID
+// (see treasure_columns.h). The scatter-add is done by one of several
+// kernels picked at runtime from the layout of the records and what the CPU
+// supports:
+//
+//   avx2    8 records per step; vectors whose IDs are all equal are reduced
+//           in registers, mixed ones fall back to the banked scalar path
+//   sse4    the same with 4 records per step (SSE4.1)
+//   scalar  portable; rotates over several accumulator banks so records of
+//           the same user do not serialize on one memory location
+//
+// The vector kernels only win when runs of records share a user, as batch
+// loads produce; on random layouts they do extra work for mixed vectors, so
+// those get the scalar kernel. How large the win is depends on the build
+// flags. TREASURE_KERNEL=scalar|sse4|avx2 overrides the choice when supported.
+
+typedef struct {
+    long long sum;
+    uint64_t count;
+    int32_t min;
+    int32_t max;
+} UserAggregate;
+
+typedef enum {
+    AGGREGATE_SCALAR,
+    AGGREGATE_SSE4,
+    AGGREGATE_AVX2
+} AggregateKernel;
+
+// Kernel for the given user column: the widest one the CPU supports when a
+// sample of it is clustered, scalar otherwise, subject to TREASURE_KERNEL
+AggregateKernel aggregate_kernel(const uint32_t *user, size_t records);
+
+int aggregate_kernel_supported(AggregateKernel kernel);
+
+const char *aggregate_kernel_name(AggregateKernel kernel);
+
+// Sets every aggregate to zero counts with min/max ready to be folded into
+void aggregate_reset(UserAggregate *out, size_t users);
+
+// Folds values[i] into out[user[i]] for every record; IDs >= users (such as
+// COLUMN_DEAD) are skipped. out must have been reset.
+void aggregate_values(AggregateKernel kernel, const uint32_t *user, const int32_t *value, size_t records,
+                      UserAggregate *out, size_t users);
+
+#endif
\ No newline at end of file
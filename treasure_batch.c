@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include "treasure_batch.h"
+
+#define NUMBER_LEN 64
+#define FIELD_COUNT 6
+#define CSV_HEADER "id,user,latitude,longitude,clue,value"
+
+enum { FIELD_ID, FIELD_USER, FIELD_LATITUDE, FIELD_LONGITUDE, FIELD_CLUE, FIELD_VALUE };
+
+static const char *field_names[FIELD_COUNT] = { "id", "user", "latitude", "longitude", "clue", "value" };
+static const size_t field_sizes[FIELD_COUNT] = { MAX_ID_LEN, MAX_NAME_LEN, NUMBER_LEN, NUMBER_LEN, MAX_CLUE_LEN, NUMBER_LEN };
+
+static int parse_float(const char *text, float min, float max, float *out) {
+    char *end;
+    errno = 0;
+    float value = strtof(text, &end);
+    if (end == text || *end != '\0' || errno != 0 || value < min || value > max) {
+        return -1;
+    }
+    *out = value;
+    return 0;
+}
+
+static int parse_int(const char *text, int *out) {
+    char *end;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno != 0 || value < INT_MIN || value > INT_MAX) {
+        return -1;
+    }
+    *out = (int)value;
+    return 0;
+}
+
+// IDs and user names are single tokens, as with the interactive prompts
+static int is_token(const char *text) {
+    if (*text == '\0') {
+        return 0;
+    }
+    for (; *text; text++) {
+        if (isspace((unsigned char)*text)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Validates the raw field text and converts it into a record
+static int fill_treasure(char fields[FIELD_COUNT][MAX_CLUE_LEN], Treasure *out, const char **error) {
+    memset(out, 0, sizeof(Treasure));
+
+    if (!is_token(fields[FIELD_ID])) {
+        *error = "id must be a non-empty word";
+        return -1;
+    }
+    if (!is_token(fields[FIELD_USER])) {
+        *error = "user must be a non-empty word";
+        return -1;
+    }
+    if (parse_float(fields[FIELD_LATITUDE], -90.0f, 90.0f, &out->latitude) == -1) {
+        *error = "latitude must be a number between -90 and 90";
+        return -1;
+    }
+    if (parse_float(fields[FIELD_LONGITUDE], -180.0f, 180.0f, &out->longitude) == -1) {
+        *error = "longitude must be a number between -180 and 180";
+        return -1;
+    }
+    if (parse_int(fields[FIELD_VALUE], &out->value) == -1) {
+        *error = "value must be an integer";
+        return -1;
+    }
+
+    strcpy(out->id, fields[FIELD_ID]);
+    strcpy(out->user, fields[FIELD_USER]);
+    strcpy(out->clue, fields[FIELD_CLUE]);
+    return 1;
+}
+
+// Copies one CSV field into buffer and advances *p past its delimiter
+static int next_csv_field(const char **p, char *buffer, size_t size, const char **error) {
+    const char *s = *p;
+    size_t length = 0;
+    int quoted = *s == '"';
+
+    if (quoted) {
+        s++;
+    }
+
+    while (*s) {
+        if (quoted && *s == '"') {
+            if (s[1] == '"') {
+                s++; // escaped quote
+            } else {
+                s++;
+                quoted = 0;
+                if (*s != ',' && *s != '\0') {
+                    *error = "unexpected text after closing quote";
+                    return -1;
+                }
+                continue;
+            }
+        } else if (!quoted && *s == ',') {
+            break;
+        }
+
+        if (length + 1 >= size) {
+            *error = "field too long";
+            return -1;
+        }
+        buffer[length++] = *s++;
+    }
+
+    if (quoted) {
+        *error = "unterminated quote";
+        return -1;
+    }
+
+    buffer[length] = '\0';
+    *p = *s == ',' ? s + 1 : s;
+    return 0;
+}
+
+static int parse_csv(const char *line, Treasure *out, const char **error) {
+    char fields[FIELD_COUNT][MAX_CLUE_LEN];
+    const char *p = line;
+
+    for (int i = 0; i < FIELD_COUNT; i++) {
+        if (i > 0 && p[-1] != ',') {
+            *error = "expected 6 comma-separated fields";
+            return -1;
+        }
+        if (next_csv_field(&p, fields[i], field_sizes[i], error) == -1) {
+            return -1;
+        }
+    }
+    if (*p != '\0') {
+        *error = "expected 6 comma-separated fields";
+        return -1;
+    }
+
+    return fill_treasure(fields, out, error);
+}
+
+static const char *skip_space(const char *s) {
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    return s;
+}
+
+// Reads a JSON string starting at the opening quote, handling the common escapes
+static const char *json_string(const char *s, char *buffer, size_t size, const char **error) {
+    size_t length = 0;
+    for (s++; *s != '"'; s++) {
+        if (*s == '\0') {
+            *error = "unterminated string";
+            return NULL;
+        }
+
+        char c = *s;
+        if (c == '\\') {
+            s++;
+            switch (*s) {
+                case '"': case '\\': case '/': c = *s; break;
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                default:
+                    *error = "unsupported escape in string";
+                    return NULL;
+            }
+        }
+
+        if (length + 1 >= size) {
+            *error = "field too long";
+            return NULL;
+        }
+        buffer[length++] = c;
+    }
+    buffer[length] = '\0';
+    return s + 1;
+}
+
+static int parse_json(const char *line, Treasure *out, const char **error) {
+    char fields[FIELD_COUNT][MAX_CLUE_LEN];
+    int seen[FIELD_COUNT] = {0};
+    const char *s = skip_space(line + 1);
+
+    while (*s != '}') {
+        char key[32];
+        if (*s != '"') {
+            *error = "expected a quoted key";
+            return -1;
+        }
+        if (!(s = json_string(s, key, sizeof(key), error))) {
+            return -1;
+        }
+
+        int field = -1;
+        for (int i = 0; i < FIELD_COUNT; i++) {
+            if (strcmp(key, field_names[i]) == 0) {
+                field = i;
+            }
+        }
+        if (field == -1) {
+            *error = "unknown key";
+            return -1;
+        }
+
+        s = skip_space(s);
+        if (*s != ':') {
+            *error = "expected ':'";
+            return -1;
+        }
+        s = skip_space(s + 1);
+
+        if (*s == '"') {
+            if (!(s = json_string(s, fields[field], field_sizes[field], error))) {
+                return -1;
+            }
+        } else {
+            // Bare number: keep its text, conversion happens in fill_treasure
+            size_t length = strcspn(s, ", \t}");
+            if (length == 0 || length >= field_sizes[field]) {
+                *error = "invalid value";
+                return -1;
+            }
+            memcpy(fields[field], s, length);
+            fields[field][length] = '\0';
+            s += length;
+        }
+        seen[field] = 1;
+
+        s = skip_space(s);
+        if (*s == ',') {
+            s = skip_space(s + 1);
+        } else if (*s != '}') {
+            *error = "expected ',' or '}'";
+            return -1;
+        }
+    }
+
+    if (*skip_space(s + 1) != '\0') {
+        *error = "unexpected text after object";
+        return -1;
+    }
+
+    for (int i = 0; i < FIELD_COUNT; i++) {
+        if (!seen[i]) {
+            *error = "missing key";
+            return -1;
+        }
+    }
+
+    return fill_treasure(fields, out, error);
+}
+
+int batch_parse_line(const char *line, int first_line, Treasure *out, const char **error) {
+    char buffer[1024];
+    const char *start = skip_space(line);
+    size_t length = strcspn(start, "\r\n");
+
+    if (length >= sizeof(buffer)) {
+        *error = "line too long";
+        return -1;
+    }
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+
+    if (buffer[0] == '\0' || buffer[0] == '#') {
+        return 0;
+    }
+    // Anything else starting with "id," is a record whose ID is "id"
+    if (first_line && strcmp(buffer, CSV_HEADER) == 0) {
+        return 0;
+    }
+
+    return buffer[0] == '{' ? parse_json(buffer, out, error) : parse_csv(buffer, out, error);
+}
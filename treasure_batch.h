@@ -0,0 +1,19 @@
+#ifndef TREASURE_BATCH_H
+#define TREASURE_BATCH_H
+
+#include "treasure.h"
+
+// Input parsing for treasure_manager --add-batch. Each line is either a JSON
+// object with the keys id, user, latitude, longitude, clue and value, or CSV
+// with the same fields in the order the interactive prompts ask for them:
+//
+//   id,user,latitude,longitude,clue,value
+//
+// CSV fields may be double-quoted ("" inside quotes is a literal quote).
+
+// Returns 1 and fills *out for a record, 0 for a line to skip (blank, #comment,
+// or the CSV header above when it is the first line), -1 for invalid input
+// with *error describing the problem.
+int batch_parse_line(const char *line, int first_line, Treasure *out, const char **error);
+
+#endif
\ No newline at end of file
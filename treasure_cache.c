@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "treasure_cache.h"
+#include "treasure_map.h"
+#include "treasure_index.h"
+
+#define WATCH_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM | \
+                      IN_DELETE_SELF | IN_MOVE_SELF)
+
+static uint32_t hash_id(const char *id) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < MAX_ID_LEN && id[i] != '\0'; i++) {
+        hash ^= (unsigned char)id[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void data_path(const char *hunt_id, char *path) {
+    snprintf(path, MAX_PATH_LEN, "hunts/%s/treasures.dat", hunt_id);
+}
+
+static void unlink_entry(HuntCache *cache, CachedHunt *hunt) {
+    if (hunt->prev) {
+        hunt->prev->next = hunt->next;
+    } else {
+        cache->head = hunt->next;
+    }
+    if (hunt->next) {
+        hunt->next->prev = hunt->prev;
+    } else {
+        cache->tail = hunt->prev;
+    }
+    hunt->prev = hunt->next = NULL;
+}
+
+static void push_front(HuntCache *cache, CachedHunt *hunt) {
+    hunt->prev = NULL;
+    hunt->next = cache->head;
+    if (cache->head) {
+        cache->head->prev = hunt;
+    } else {
+        cache->tail = hunt;
+    }
+    cache->head = hunt;
+}
+
+static void free_hunt(CachedHunt *hunt) {
+    free(hunt->records);
+    free(hunt->slots);
+    free(hunt);
+}
+
+static void remove_watch(HuntCache *cache, CachedHunt *hunt) {
+    if (hunt->watch != -1) {
+        inotify_rm_watch(cache->inotify_fd, hunt->watch);
+        hunt->watch = -1;
+    }
+}
+
+// Takes the entry out of the cache; readers still using it keep it alive
+static void drop_entry(HuntCache *cache, CachedHunt *hunt) {
+    unlink_entry(cache, hunt);
+    cache->bytes -= hunt->bytes;
+    remove_watch(cache, hunt);
+    if (hunt->refs == 0) {
+        free_hunt(hunt);
+    } else {
+        hunt->detached = 1;
+    }
+}
+
+// Marks entries whose treasures.dat changed since they were loaded
+static void drain_events(HuntCache *cache) {
+    if (cache->inotify_fd == -1) {
+        return;
+    }
+
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while ((length = read(cache->inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char *p = buffer; p < buffer + length;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            // Lost events could hide any change
+            if (event->mask & IN_Q_OVERFLOW) {
+                for (CachedHunt *hunt = cache->head; hunt; hunt = hunt->next) {
+                    hunt->stale = 1;
+                }
+                continue;
+            }
+
+            // Other files in the hunt directory, such as the log, do not matter
+            if (event->len > 0 && strcmp(event->name, "treasures.dat") != 0) {
+                continue;
+            }
+            for (CachedHunt *hunt = cache->head; hunt; hunt = hunt->next) {
+                if (hunt->watch == event->wd) {
+                    hunt->stale = 1;
+                }
+            }
+        }
+    }
+}
+
+static int unchanged(const CachedHunt *hunt) {
+    char path[MAX_PATH_LEN];
+    data_path(hunt->hunt_id, path);
+
+    struct stat st;
+    return stat(path, &st) == 0 && st.st_dev == hunt->device && st.st_ino == hunt->inode &&
+           st.st_size == hunt->size && st.st_mtim.tv_sec == hunt->mtime.tv_sec &&
+           st.st_mtim.tv_nsec == hunt->mtime.tv_nsec;
+}
+
+static int append_record(CachedHunt *hunt, size_t *capacity, const Treasure *treasure) {
+    if (hunt->count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        Treasure *records = realloc(hunt->records, *capacity * sizeof(Treasure));
+        if (!records) {
+            return -1;
+        }
+        hunt->records = records;
+    }
+    hunt->records[hunt->count++] = *treasure;
+    return 0;
+}
+
+// Builds the ID table; the first record wins for duplicate IDs, as in the index
+static int build_slots(CachedHunt *hunt) {
+    hunt->slot_count = 16;
+    while (hunt->slot_count < hunt->count * 2) {
+        hunt->slot_count *= 2;
+    }
+    hunt->slots = calloc(hunt->slot_count, sizeof(uint32_t));
+    if (!hunt->slots) {
+        return -1;
+    }
+
+    size_t mask = hunt->slot_count - 1;
+    for (size_t r = 0; r < hunt->count; r++) {
+        size_t i = hash_id(hunt->records[r].id) & mask;
+        for (; hunt->slots[i] != 0; i = (i + 1) & mask) {
+            if (strncmp(hunt->records[hunt->slots[i] - 1].id, hunt->records[r].id, MAX_ID_LEN) == 0) {
+                break;
+            }
+        }
+        if (hunt->slots[i] == 0) {
+            hunt->slots[i] = r + 1;
+        }
+    }
+    return 0;
+}
+
+// Reads the hunt's live records into an entry; runs without the cache lock
+static int load_records(CachedHunt *hunt) {
+    char path[MAX_PATH_LEN];
+    data_path(hunt->hunt_id, path);
+    struct stat st;
+    TreasureMap map;
+    if (stat(path, &st) == -1 || treasure_map_open(hunt->hunt_id, &map) == -1) {
+        return -1;
+    }
+    hunt->device = st.st_dev;
+    hunt->inode = st.st_ino;
+    hunt->size = st.st_size;
+    hunt->mtime = st.st_mtim;
+
+    size_t capacity = 0;
+    int ok = 1;
+    const Treasure *treasure;
+    while (ok && (treasure = treasure_map_next(&map, NULL)) != NULL) {
+        if (treasure_is_live(treasure)) {
+            ok = append_record(hunt, &capacity, treasure) == 0;
+        }
+    }
+    treasure_map_close(&map);
+
+    hunt->bytes = sizeof(CachedHunt) + capacity * sizeof(Treasure);
+    if (!ok || build_slots(hunt) == -1) {
+        return -1;
+    }
+    hunt->bytes += hunt->slot_count * sizeof(uint32_t);
+    return 0;
+}
+
+int hunt_cache_init(HuntCache *cache) {
+    memset(cache, 0, sizeof(HuntCache));
+
+    double megabytes = DEFAULT_CACHE_MB;
+    const char *setting = getenv("TREASURE_CACHE_MB");
+    if (setting) {
+        megabytes = atof(setting);
+    }
+    cache->budget = megabytes > 0 ? (size_t)(megabytes * 1024 * 1024) : 0;
+
+    cache->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (cache->inotify_fd == -1) {
+        perror("inotify_init1 (falling back to stat checks)");
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->loaded, NULL);
+    return 0;
+}
+
+const CachedHunt *hunt_cache_get(HuntCache *cache, const char *hunt_id) {
+    if (cache->budget == 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    CachedHunt *hunt;
+    int size_checked = 0;
+    while (1) {
+        drain_events(cache);
+        hunt = cache->head;
+        while (hunt && strcmp(hunt->hunt_id, hunt_id) != 0) {
+            hunt = hunt->next;
+        }
+        if (hunt && hunt->loading) {
+            pthread_cond_wait(&cache->loaded, &cache->lock);
+            continue;
+        }
+
+        if (hunt && !hunt->stale && (hunt->watch != -1 || unchanged(hunt))) {
+            unlink_entry(cache, hunt);
+            push_front(cache, hunt);
+            hunt->refs++;
+            pthread_mutex_unlock(&cache->lock);
+            return hunt;
+        }
+        if (hunt) {
+            drop_entry(cache, hunt);
+        }
+        if (size_checked) {
+            break;
+        }
+
+        // Skip loading hunts the index header already shows cannot fit. The
+        // header is read without the lock, so look the hunt up again after.
+        pthread_mutex_unlock(&cache->lock);
+        size_t records;
+        size_t dead;
+        if (index_counts(hunt_id, &records, &dead) == 0 && (records - dead) * sizeof(Treasure) > cache->budget) {
+            return NULL;
+        }
+        size_checked = 1;
+        pthread_mutex_lock(&cache->lock);
+    }
+
+    hunt = calloc(1, sizeof(CachedHunt));
+    if (!hunt) {
+        pthread_mutex_unlock(&cache->lock);
+        return NULL;
+    }
+    snprintf(hunt->hunt_id, MAX_PATH_LEN, "%s", hunt_id);
+    hunt->loading = 1;
+    hunt->refs = 1;
+
+    // Watch before reading so a write racing with the load still invalidates it
+    char dir_path[MAX_PATH_LEN];
+    snprintf(dir_path, MAX_PATH_LEN, "hunts/%s", hunt_id);
+    hunt->watch = cache->inotify_fd != -1 ? inotify_add_watch(cache->inotify_fd, dir_path, WATCH_EVENTS) : -1;
+    push_front(cache, hunt);
+    pthread_mutex_unlock(&cache->lock);
+
+    int loaded = load_records(hunt) == 0;
+
+    pthread_mutex_lock(&cache->lock);
+    hunt->loading = 0;
+    pthread_cond_broadcast(&cache->loaded);
+
+    // Never worth evicting everything else for
+    if (!loaded || hunt->bytes > cache->budget) {
+        unlink_entry(cache, hunt);
+        remove_watch(cache, hunt);
+        free_hunt(hunt);
+        pthread_mutex_unlock(&cache->lock);
+        return NULL;
+    }
+
+    cache->bytes += hunt->bytes;
+    for (CachedHunt *victim = cache->tail; victim && cache->bytes > cache->budget;) {
+        CachedHunt *prev = victim->prev;
+        if (victim != hunt && !victim->loading) {
+            drop_entry(cache, victim);
+        }
+        victim = prev;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return hunt;
+}
+
+void hunt_cache_release(HuntCache *cache, const CachedHunt *entry) {
+    CachedHunt *hunt = (CachedHunt *)entry;
+    pthread_mutex_lock(&cache->lock);
+    if (--hunt->refs == 0 && hunt->detached) {
+        free_hunt(hunt);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+const Treasure *cached_hunt_find(const CachedHunt *hunt, const char *treasure_id) {
+    size_t mask = hunt->slot_count - 1;
+    for (size_t i = hash_id(treasure_id) & mask; hunt->slots[i] != 0; i = (i + 1) & mask) {
+        const Treasure *treasure = &hunt->records[hunt->slots[i] - 1];
+        if (strncmp(treasure->id, treasure_id, MAX_ID_LEN) == 0) {
+            return treasure;
+        }
+    }
+    return NULL;
+}
+
+void hunt_cache_free(HuntCache *cache) {
+    while (cache->head) {
+        drop_entry(cache, cache->head);
+    }
+    if (cache->inotify_fd != -1) {
+        close(cache->inotify_fd);
+    }
+    pthread_mutex_destroy(&cache->lock);
+    pthread_cond_destroy(&cache->loaded);
+    memset(cache, 0, sizeof(HuntCache));
+    cache->inotify_fd = -1;
+}
\ No newline at end of file
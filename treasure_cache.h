@@ -0,0 +1,76 @@
+#ifndef TREASURE_CACHE_H
+#define TREASURE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include "treasure.h"
+
+// In-memory cache of parsed hunts for the long-lived monitor. Each entry holds
+// a hunt's live records in file order plus an ID hash table over them, and
+// entries are evicted least recently used first once their total size passes
+// the budget (TREASURE_CACHE_MB, default 64).
+//
+// Entries are invalidated by inotify watches on hunts/<id>/, so a hit costs
+// one non-blocking read of the inotify descriptor and no filesystem access.
+// Where inotify is unavailable each hit is validated with a stat of
+// treasures.dat instead.
+//
+// The cache is shared by the monitor's worker threads. Readers hold a
+// reference to an entry while they use it, so eviction only unlinks entries
+// in use and the last reader frees them. A hunt is loaded outside the cache
+// lock: its entry sits in the list marked loading, and other readers of that
+// hunt wait for it while readers of other hunts carry on.
+
+#define DEFAULT_CACHE_MB 64
+
+typedef struct CachedHunt {
+    char hunt_id[MAX_PATH_LEN];
+    Treasure *records;
+    size_t count;
+    uint32_t *slots;  // 1-based index into records, 0 when empty
+    size_t slot_count; // power of two, at most half full
+    size_t bytes;
+    int watch;        // inotify watch descriptor, -1 when stat-validated
+    int stale;
+    int loading;      // records are still being read
+    int refs;         // readers using the entry
+    int detached;     // dropped from the list, freed by the last reader
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec mtime;
+    struct CachedHunt *prev; // towards the most recently used
+    struct CachedHunt *next;
+} CachedHunt;
+
+typedef struct {
+    CachedHunt *head; // most recently used
+    CachedHunt *tail;
+    size_t bytes;
+    size_t budget;
+    int inotify_fd;
+    pthread_mutex_t lock;
+    pthread_cond_t loaded; // signalled when a load finishes
+} HuntCache;
+
+// Sets up the cache with the budget from TREASURE_CACHE_MB. Returns 0; a
+// missing inotify only switches the cache to stat validation.
+int hunt_cache_init(HuntCache *cache);
+
+// Returns the hunt, loading it on a miss or after a change. The entry stays
+// valid until it is passed to hunt_cache_release. Returns NULL when the hunt
+// cannot be read or does not fit in the budget; callers then read the file
+// directly.
+const CachedHunt *hunt_cache_get(HuntCache *cache, const char *hunt_id);
+
+void hunt_cache_release(HuntCache *cache, const CachedHunt *hunt);
+
+// Looks up a live treasure in a cached hunt
+const Treasure *cached_hunt_find(const CachedHunt *hunt, const char *treasure_id);
+
+void hunt_cache_free(HuntCache *cache);
+
+#endif
\ No newline at end of file
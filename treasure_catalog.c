@@ -0,0 +1,444 @@
+#define _GNU_SOURCE // F_OFD_SETLK
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "treasure.h"
+#include "treasure_map.h"
+#include "treasure_lock.h"
+#include "treasure_catalog.h"
+
+#define CATALOG_MAGIC "TCAT"
+#define CATALOG_VERSION 1
+#define MIN_CAPACITY 64
+
+#define SLOT_EMPTY 0
+#define SLOT_USED 1
+#define SLOT_DROPPED 2 // keeps its ID so probe chains stay intact
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t capacity; // slots, a power of two
+    uint64_t used;     // slots ever claimed, dropped ones included
+    char reserved[40];
+} CatalogHeader;
+
+typedef struct {
+    char hunt_id[CATALOG_ID_LEN];
+    uint32_t state;
+    uint32_t reserved;
+    HuntSummary summary;
+    int64_t data_size; // size of treasures.dat the summary describes
+    char padding[8];
+} CatalogSlot;
+
+// A writer's change; NULL means recount
+typedef struct {
+    off_t old_size;
+    off_t new_size;
+    int64_t records;
+    int64_t live;
+    int64_t value;
+} CatalogChange;
+
+static uint64_t hash_id(const char *id) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; id[i] != '\0'; i++) {
+        hash ^= (unsigned char)id[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static off_t slot_offset(uint64_t index) {
+    return sizeof(CatalogHeader) + index * sizeof(CatalogSlot);
+}
+
+// Takes, converts or (F_UNLCK) drops an open-file-description lock on a byte
+// range, waiting for conflicting holders; length 0 reaches past the end
+static int range_lock(int fd, short type, off_t start, off_t length) {
+    struct flock lock = { .l_type = type, .l_whence = SEEK_SET, .l_start = start, .l_len = length };
+    while (fcntl(fd, type == F_UNLCK ? F_OFD_SETLK : F_OFD_SETLKW, &lock) == -1) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int write_at(int fd, const void *data, size_t length, off_t offset) {
+    const char *p = data;
+    while (length > 0) {
+        ssize_t bytes = pwrite(fd, p, length, offset);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += bytes;
+        length -= bytes;
+        offset += bytes;
+    }
+    return 0;
+}
+
+// Counts the hunt's records from treasures.dat into slot
+static int summarize(const char *hunt_id, CatalogSlot *slot) {
+    TreasureMap map;
+    if (treasure_map_open(hunt_id, &map) == -1) {
+        return -1;
+    }
+
+    memset(&slot->summary, 0, sizeof(HuntSummary));
+    const Treasure *treasure;
+    while ((treasure = treasure_map_next(&map, NULL)) != NULL) {
+        slot->summary.records++;
+        if (treasure_is_live(treasure)) {
+            slot->summary.live++;
+            slot->summary.total_value += treasure->value;
+        }
+    }
+    slot->data_size = map.length;
+    treasure_map_close(&map);
+
+    char path[MAX_PATH_LEN];
+    snprintf(path, MAX_PATH_LEN, "hunts/%s/treasures.dat", hunt_id);
+    struct stat st;
+    slot->summary.modified = stat(path, &st) == 0 ? st.st_mtime : time(NULL);
+    return 0;
+}
+
+// Writes a fresh catalog holding the given slots. With replace the current
+// catalog is replaced; otherwise the new one only takes the place of a
+// missing catalog, so of two concurrent builds the first one wins.
+static int write_catalog(const CatalogSlot *slots, size_t count, int replace) {
+    CatalogHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CATALOG_MAGIC, 4);
+    header.version = CATALOG_VERSION;
+    header.capacity = MIN_CAPACITY;
+    while (header.capacity < count * 2) {
+        header.capacity *= 2;
+    }
+    header.used = count;
+
+    CatalogSlot *table = calloc(header.capacity, sizeof(CatalogSlot));
+    if (!table) {
+        return -1;
+    }
+    uint64_t mask = header.capacity - 1;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t index = hash_id(slots[i].hunt_id) & mask;
+        while (table[index].state != SLOT_EMPTY) {
+            index = (index + 1) & mask;
+        }
+        table[index] = slots[i];
+    }
+
+    char temp_path[MAX_PATH_LEN];
+    int fd = temp_file_create(CATALOG_PATH, temp_path);
+    if (fd == -1) {
+        free(table);
+        return -1;
+    }
+    int ok = write_at(fd, &header, sizeof(header), 0) == 0 &&
+             write_at(fd, table, header.capacity * sizeof(CatalogSlot), sizeof(header)) == 0;
+    free(table);
+    if (replace) {
+        close(fd);
+        if (!ok) {
+            remove(temp_path);
+            return -1;
+        }
+        return durable_replace(temp_path, CATALOG_PATH);
+    }
+
+    ok = ok && fsync(fd) == 0;
+    close(fd);
+    if (ok && link(temp_path, CATALOG_PATH) == -1 && errno != EEXIST) {
+        ok = 0;
+    }
+    remove(temp_path);
+    if (!ok) {
+        return -1;
+    }
+
+    int dir_fd = open("hunts", O_RDONLY | O_DIRECTORY);
+    if (dir_fd != -1) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return 0;
+}
+
+// Builds the catalog from the hunts directory when there is none yet
+static int build_catalog() {
+    DIR *dir = opendir("hunts");
+    if (!dir) {
+        return -1;
+    }
+
+    CatalogSlot *slots = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    int ok = 1;
+    struct dirent *entry;
+    while (ok && (entry = readdir(dir)) != NULL) {
+        // Hunts are the directories; this file and dot entries are not
+        if (entry->d_name[0] == '.' || (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN) ||
+            strlen(entry->d_name) >= CATALOG_ID_LEN) {
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            CatalogSlot *grown = realloc(slots, capacity * sizeof(CatalogSlot));
+            if (!grown) {
+                ok = 0;
+                break;
+            }
+            slots = grown;
+        }
+
+        CatalogSlot *slot = &slots[count];
+        memset(slot, 0, sizeof(CatalogSlot));
+        memcpy(slot->hunt_id, entry->d_name, strlen(entry->d_name) + 1);
+        slot->state = SLOT_USED;
+        // A hunt whose first add is still running has no treasures.dat yet;
+        // that add will catalog it
+        if (summarize(entry->d_name, slot) == 0) {
+            count++;
+        }
+    }
+    closedir(dir);
+
+    if (ok) {
+        ok = write_catalog(slots, count, 0) == 0;
+    }
+    free(slots);
+    return ok ? 0 : -1;
+}
+
+// Opens the current catalog with its header locked (F_RDLCK or F_WRLCK),
+// building it first if needed. Returns the fd, or -1.
+static int open_catalog(short type, int flags, CatalogHeader *header) {
+    while (1) {
+        int fd = open(CATALOG_PATH, flags | O_CLOEXEC);
+        if (fd == -1) {
+            if (errno != ENOENT || build_catalog() == -1) {
+                return -1;
+            }
+            continue;
+        }
+
+        struct stat locked;
+        struct stat current;
+        if (range_lock(fd, type, 0, sizeof(CatalogHeader)) == -1 || fstat(fd, &locked) == -1) {
+            close(fd);
+            return -1;
+        }
+        if (stat(CATALOG_PATH, &current) == 0 && current.st_ino == locked.st_ino) {
+            if (pread(fd, header, sizeof(CatalogHeader), 0) == sizeof(CatalogHeader) &&
+                memcmp(header->magic, CATALOG_MAGIC, 4) == 0 && header->version == CATALOG_VERSION &&
+                header->capacity >= MIN_CAPACITY && (header->capacity & (header->capacity - 1)) == 0 &&
+                locked.st_size >= slot_offset(header->capacity)) {
+                return fd;
+            }
+            // Everything in it can be recounted
+            unlink(CATALOG_PATH);
+        }
+        close(fd); // replaced while we waited: use the new one
+    }
+}
+
+// Finds the hunt's slot, or the empty slot it would take. Returns 1 if found,
+// 0 if not, -1 on error.
+static int find_slot(int fd, const CatalogHeader *header, const char *hunt_id, uint64_t *index) {
+    uint64_t mask = header->capacity - 1;
+    for (uint64_t n = 0, i = hash_id(hunt_id) & mask; n < header->capacity; n++, i = (i + 1) & mask) {
+        CatalogSlot slot;
+        if (pread(fd, &slot, sizeof(slot), slot_offset(i)) != sizeof(slot)) {
+            return -1;
+        }
+        if (slot.state == SLOT_EMPTY || strncmp(slot.hunt_id, hunt_id, CATALOG_ID_LEN) == 0) {
+            *index = i;
+            return slot.state != SLOT_EMPTY;
+        }
+    }
+    errno = ENOSPC;
+    return -1;
+}
+
+// Rewrites the catalog at twice the size it needs, without dropped hunts.
+// Needs the header's exclusive lock.
+static int grow_catalog(int fd, const CatalogHeader *header) {
+    if (range_lock(fd, F_WRLCK, 0, 0) == -1) {
+        return -1;
+    }
+
+    size_t length = slot_offset(header->capacity);
+    char *base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    CatalogSlot *slots = malloc((header->used ? header->used : 1) * sizeof(CatalogSlot));
+    if (base == MAP_FAILED || !slots) {
+        if (base != MAP_FAILED) {
+            munmap(base, length);
+        }
+        free(slots);
+        return -1;
+    }
+
+    size_t count = 0;
+    for (uint64_t i = 0; i < header->capacity && count < header->used; i++) {
+        const CatalogSlot *slot = (const CatalogSlot *)(base + slot_offset(i));
+        if (slot->state == SLOT_USED) {
+            slots[count++] = *slot;
+        }
+    }
+    munmap(base, length);
+
+    int result = write_catalog(slots, count, 1);
+    free(slots);
+    return result;
+}
+
+static int write_entry(const char *hunt_id, const CatalogChange *change) {
+    if (strlen(hunt_id) >= CATALOG_ID_LEN) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    // Updating a slot shares the header; claiming one needs it exclusively
+    short type = F_RDLCK;
+    while (1) {
+        CatalogHeader header;
+        int fd = open_catalog(type, O_RDWR, &header);
+        if (fd == -1) {
+            return -1;
+        }
+
+        uint64_t index;
+        int found = find_slot(fd, &header, hunt_id, &index);
+        if (found == -1) {
+            close(fd);
+            return -1;
+        }
+        if (!found && type == F_RDLCK) {
+            close(fd);
+            type = F_WRLCK;
+            continue;
+        }
+        if (!found && (header.used + 1) * 4 > header.capacity * 3) {
+            int grown = grow_catalog(fd, &header);
+            close(fd);
+            if (grown == -1) {
+                return -1;
+            }
+            continue;
+        }
+
+        CatalogSlot slot;
+        off_t position = slot_offset(index);
+        int ok = range_lock(fd, F_WRLCK, position, sizeof(CatalogSlot)) == 0 &&
+                 pread(fd, &slot, sizeof(slot), position) == sizeof(slot);
+        if (ok && found && slot.state == SLOT_USED && change && slot.data_size == change->old_size) {
+            slot.summary.records += change->records;
+            slot.summary.live += change->live;
+            slot.summary.total_value += change->value;
+            slot.summary.modified = time(NULL);
+            slot.data_size = change->new_size;
+        } else if (ok) {
+            memset(&slot, 0, sizeof(slot));
+            snprintf(slot.hunt_id, CATALOG_ID_LEN, "%s", hunt_id);
+            ok = summarize(hunt_id, &slot) == 0;
+        }
+        slot.state = SLOT_USED;
+
+        // One write per slot, so readers see it before or after, never between
+        ok = ok && write_at(fd, &slot, sizeof(slot), position) == 0;
+        if (ok && !found) {
+            header.used++;
+            ok = write_at(fd, &header, sizeof(header), 0) == 0;
+        }
+        close(fd); // drops the locks
+        return ok ? 0 : -1;
+    }
+}
+
+int catalog_update(const char *hunt_id, off_t old_size, off_t new_size,
+                   int64_t records, int64_t live, int64_t value) {
+    CatalogChange change = { old_size, new_size, records, live, value };
+    return write_entry(hunt_id, &change);
+}
+
+int catalog_refresh(const char *hunt_id) {
+    return write_entry(hunt_id, NULL);
+}
+
+int catalog_drop(const char *hunt_id) {
+    CatalogHeader header;
+    int fd = open_catalog(F_RDLCK, O_RDWR, &header);
+    if (fd == -1) {
+        return -1;
+    }
+
+    uint64_t index;
+    int found = find_slot(fd, &header, hunt_id, &index);
+    int ok = found != -1;
+    if (found == 1) {
+        uint32_t state = SLOT_DROPPED;
+        off_t position = slot_offset(index);
+        ok = range_lock(fd, F_WRLCK, position, sizeof(CatalogSlot)) == 0 &&
+             write_at(fd, &state, sizeof(state), position + offsetof(CatalogSlot, state)) == 0;
+    }
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+int catalog_list(CatalogEntry **entries, size_t *count) {
+    CatalogHeader header;
+    int fd = open_catalog(F_RDLCK, O_RDONLY, &header);
+    if (fd == -1) {
+        return -1;
+    }
+
+    // Shared over the whole file: waits out slot writes in progress
+    size_t length = slot_offset(header.capacity);
+    char *base = MAP_FAILED;
+    if (range_lock(fd, F_RDLCK, 0, 0) == 0) {
+        base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    *entries = malloc((header.used ? header.used : 1) * sizeof(CatalogEntry));
+    if (base == MAP_FAILED || !*entries) {
+        if (base != MAP_FAILED) {
+            munmap(base, length);
+        }
+        free(*entries);
+        close(fd);
+        return -1;
+    }
+    madvise(base, length, MADV_SEQUENTIAL);
+
+    *count = 0;
+    for (uint64_t i = 0; i < header.capacity && *count < header.used; i++) {
+        const CatalogSlot *slot = (const CatalogSlot *)(base + slot_offset(i));
+        if (slot->state == SLOT_USED) {
+            CatalogEntry *entry = &(*entries)[(*count)++];
+            memcpy(entry->hunt_id, slot->hunt_id, CATALOG_ID_LEN);
+            entry->hunt_id[CATALOG_ID_LEN - 1] = '\0';
+            entry->summary = slot->summary;
+        }
+    }
+
+    munmap(base, length);
+    close(fd);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#ifndef TREASURE_CATALOG_H
+#define TREASURE_CATALOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Catalog of every hunt (hunts/CATALOG), so listing hunts reads one file
+// instead of opening something in each hunt directory.
+//
+// The catalog is an open-addressing hash table of fixed-size slots keyed by
+// hunt ID. treasure_manager updates a hunt's slot after each change while it
+// holds the hunt's lock; the slot is rewritten with a single pwrite under an
+// fcntl range lock on just that slot, so writers to different hunts do not
+// wait for each other and readers, which lock the whole file shared, never
+// see a slot half written. Claiming a new slot locks the header instead, and
+// growing the table replaces the file, which is why every open rechecks
+// that it still holds the current one.
+//
+// Each slot remembers the size of treasures.dat it describes. An update
+// whose "before" size does not match, for instance after a crash between a
+// write and its catalog update, recounts the hunt from treasures.dat instead
+// of applying its deltas. Tombstones do not change the size, so only
+// compaction (which recounts) repairs a lost removal.
+//
+// The catalog is built from the hunts directory by whoever first needs it.
+// Hunt IDs of CATALOG_ID_LEN bytes or more are not catalogued.
+
+#define CATALOG_PATH "hunts/CATALOG"
+#define CATALOG_ID_LEN 200
+
+typedef struct {
+    uint64_t records;    // records in treasures.dat, tombstones included
+    uint64_t live;       // records not removed
+    int64_t total_value; // sum of the live records' values
+    int64_t modified;    // time of the last change, seconds since the epoch
+} HuntSummary;
+
+typedef struct {
+    char hunt_id[CATALOG_ID_LEN];
+    HuntSummary summary;
+} CatalogEntry;
+
+// Records a change a writer made to treasures.dat, which grew from old_size
+// to new_size bytes: records appended, live and total_value changed by the
+// given amounts. Returns 0 or -1.
+int catalog_update(const char *hunt_id, off_t old_size, off_t new_size,
+                   int64_t records, int64_t live, int64_t value);
+
+// Recounts the hunt from treasures.dat, after a rewrite or journal replay
+int catalog_refresh(const char *hunt_id);
+
+// Forgets a removed hunt. Returns 0 or -1.
+int catalog_drop(const char *hunt_id);
+
+// Copies out every catalogued hunt; *entries is malloc'd and owned by the
+// caller. Returns 0, or -1 when there is no hunts directory or on error.
+int catalog_list(CatalogEntry **entries, size_t *count);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "treasure_columns.h"
+#include "treasure_map.h"
+
+#define COLUMNS_MAGIC "TCOL"
+#define COLUMNS_VERSION 1
+#define INITIAL_ROWS 1024
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t data_size;  // size of treasures.dat the columns describe
+    uint64_t data_inode; // inode of treasures.dat, catches replaced files
+    uint64_t records;    // entries in every column file
+    uint64_t users;      // entries in users.dict
+} ColumnsHeader;
+
+enum { COLUMN_USER, COLUMN_VALUE, COLUMN_LAT, COLUMN_LON, COLUMN_OFFSET, COLUMN_COUNT };
+
+static const char *column_files[COLUMN_COUNT] = {"user.u32", "value.i32", "lat.f32", "lon.f32", "offset.i64"};
+static const size_t column_widths[COLUMN_COUNT] = {4, 4, 4, 4, 8};
+
+// User names interned to dense IDs in first-seen order
+typedef struct {
+    char (*names)[MAX_NAME_LEN];
+    size_t count;
+    size_t capacity;
+    uint32_t *slots; // 1-based dictionary ID, 0 when empty
+    size_t slot_count;
+} Dictionary;
+
+// One buffer per column for a run of consecutive records
+typedef struct {
+    char *data[COLUMN_COUNT];
+    size_t count;
+    size_t capacity;
+} ColumnRows;
+
+static void column_path(const char *hunt_id, const char *file, char *path) {
+    snprintf(path, MAX_PATH_LEN, "hunts/%s/columns/%s", hunt_id, file);
+}
+
+static uint32_t hash_name(const char *name) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < MAX_NAME_LEN && name[i] != '\0'; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int dict_grow_slots(Dictionary *dict) {
+    size_t slot_count = dict->slot_count ? dict->slot_count * 2 : 128;
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (!slots) {
+        return -1;
+    }
+
+    size_t mask = slot_count - 1;
+    for (size_t id = 0; id < dict->count; id++) {
+        size_t i = hash_name(dict->names[id]) & mask;
+        while (slots[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = id + 1;
+    }
+
+    free(dict->slots);
+    dict->slots = slots;
+    dict->slot_count = slot_count;
+    return 0;
+}
+
+// Returns the user's dictionary ID, adding it if new, or -1 when out of memory
+static int64_t dict_intern(Dictionary *dict, const char *name) {
+    if ((dict->count + 1) * 2 > dict->slot_count && dict_grow_slots(dict) == -1) {
+        return -1;
+    }
+
+    size_t mask = dict->slot_count - 1;
+    size_t i = hash_name(name) & mask;
+    for (; dict->slots[i] != 0; i = (i + 1) & mask) {
+        if (strncmp(dict->names[dict->slots[i] - 1], name, MAX_NAME_LEN) == 0) {
+            return dict->slots[i] - 1;
+        }
+    }
+
+    if (dict->count == dict->capacity) {
+        size_t capacity = dict->capacity ? dict->capacity * 2 : 64;
+        char (*names)[MAX_NAME_LEN] = realloc(dict->names, capacity * MAX_NAME_LEN);
+        if (!names) {
+            return -1;
+        }
+        dict->names = names;
+        dict->capacity = capacity;
+    }
+
+    memset(dict->names[dict->count], 0, MAX_NAME_LEN);
+    strncpy(dict->names[dict->count], name, MAX_NAME_LEN - 1);
+    dict->slots[i] = dict->count + 1;
+    return dict->count++;
+}
+
+static void dict_free(Dictionary *dict) {
+    free(dict->names);
+    free(dict->slots);
+    memset(dict, 0, sizeof(Dictionary));
+}
+
+// Loads the first `count` names of users.dict
+static int dict_load(const char *hunt_id, size_t count, Dictionary *dict) {
+    memset(dict, 0, sizeof(Dictionary));
+
+    char path[MAX_PATH_LEN];
+    column_path(hunt_id, "users.dict", path);
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+
+    char name[MAX_NAME_LEN];
+    int ok = 1;
+    for (size_t i = 0; i < count && ok; i++) {
+        ok = fread(name, MAX_NAME_LEN, 1, file) == 1 && dict_intern(dict, name) == (int64_t)i;
+    }
+    fclose(file);
+
+    if (!ok) {
+        dict_free(dict);
+        return -1;
+    }
+    return 0;
+}
+
+static int rows_add(ColumnRows *rows, uint32_t user, const Treasure *treasure, off_t offset) {
+    if (rows->count == rows->capacity) {
+        size_t capacity = rows->capacity ? rows->capacity * 2 : INITIAL_ROWS;
+        for (int c = 0; c < COLUMN_COUNT; c++) {
+            char *data = realloc(rows->data[c], capacity * column_widths[c]);
+            if (!data) {
+                return -1;
+            }
+            rows->data[c] = data;
+        }
+        rows->capacity = capacity;
+    }
+
+    size_t i = rows->count++;
+    int64_t position = offset;
+    memcpy(rows->data[COLUMN_USER] + i * 4, &user, 4);
+    memcpy(rows->data[COLUMN_VALUE] + i * 4, &treasure->value, 4);
+    memcpy(rows->data[COLUMN_LAT] + i * 4, &treasure->latitude, 4);
+    memcpy(rows->data[COLUMN_LON] + i * 4, &treasure->longitude, 4);
+    memcpy(rows->data[COLUMN_OFFSET] + i * 8, &position, 8);
+    return 0;
+}
+
+static void rows_free(ColumnRows *rows) {
+    for (int c = 0; c < COLUMN_COUNT; c++) {
+        free(rows->data[c]);
+    }
+    memset(rows, 0, sizeof(ColumnRows));
+}
+
+static int rows_add_treasure(ColumnRows *rows, Dictionary *dict, const Treasure *treasure, off_t offset) {
+    int64_t user = COLUMN_DEAD;
+    if (treasure_is_live(treasure) && (user = dict_intern(dict, treasure->user)) == -1) {
+        return -1;
+    }
+    return rows_add(rows, user, treasure, offset);
+}
+
+// Writes `length` bytes at position of a file in the columns directory
+static int write_at(const char *hunt_id, const char *file, const void *data, size_t length, off_t position, int truncate) {
+    char path[MAX_PATH_LEN];
+    column_path(hunt_id, file, path);
+
+    int fd = open(path, O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0), 0666);
+    if (fd == -1) {
+        return -1;
+    }
+    int ok = length == 0 || pwrite(fd, data, length, position) == (ssize_t)length;
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+// Stores rows as entries first_record onwards of every column
+static int write_rows(const char *hunt_id, const ColumnRows *rows, size_t first_record, int truncate) {
+    for (int c = 0; c < COLUMN_COUNT; c++) {
+        if (write_at(hunt_id, column_files[c], rows->data[c], rows->count * column_widths[c],
+                     (off_t)first_record * column_widths[c], truncate) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int write_names(const char *hunt_id, const Dictionary *dict, size_t first, int truncate) {
+    return write_at(hunt_id, "users.dict", dict->names ? dict->names[first] : NULL,
+                    (dict->count - first) * MAX_NAME_LEN, (off_t)first * MAX_NAME_LEN, truncate);
+}
+
+static int read_header(const char *hunt_id, ColumnsHeader *header) {
+    char path[MAX_PATH_LEN];
+    column_path(hunt_id, "meta", path);
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    int ok = pread(fd, header, sizeof(ColumnsHeader), 0) == sizeof(ColumnsHeader) &&
+             memcmp(header->magic, COLUMNS_MAGIC, 4) == 0 && header->version == COLUMNS_VERSION;
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+static int write_header(const char *hunt_id, ColumnsHeader *header) {
+    memcpy(header->magic, COLUMNS_MAGIC, 4);
+    header->version = COLUMNS_VERSION;
+    return write_at(hunt_id, "meta", header, sizeof(ColumnsHeader), 0, 0);
+}
+
+static int data_stat(const char *hunt_id, struct stat *st) {
+    char path[MAX_PATH_LEN];
+    snprintf(path, MAX_PATH_LEN, "hunts/%s/treasures.dat", hunt_id);
+    return stat(path, st);
+}
+
+static int have_columns(const char *hunt_id) {
+    char path[MAX_PATH_LEN];
+    snprintf(path, MAX_PATH_LEN, "hunts/%s/columns", hunt_id);
+    return access(path, F_OK) == 0;
+}
+
+// Maps the first `length` bytes of a column file. Returns NULL for an empty
+// column and MAP_FAILED on errors, including files shorter than length.
+static const void *map_column(const char *hunt_id, const char *file, size_t length) {
+    if (length == 0) {
+        return NULL;
+    }
+
+    char path[MAX_PATH_LEN];
+    column_path(hunt_id, file, path);
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return MAP_FAILED;
+    }
+
+    struct stat st;
+    void *base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= length) {
+        base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    return base;
+}
+
+static void unmap_column(const void *base, size_t length) {
+    if (base && base != MAP_FAILED) {
+        munmap((void *)base, length);
+    }
+}
+
+int columns_open(const char *hunt_id, ColumnSet *columns) {
+    memset(columns, 0, sizeof(ColumnSet));
+
+    ColumnsHeader header;
+    struct stat st;
+    if (read_header(hunt_id, &header) == -1 || data_stat(hunt_id, &st) == -1 ||
+        header.data_size != (uint64_t)st.st_size || header.data_inode != (uint64_t)st.st_ino) {
+        return -1;
+    }
+
+    const void *user = map_column(hunt_id, column_files[COLUMN_USER], header.records * 4);
+    const void *value = map_column(hunt_id, column_files[COLUMN_VALUE], header.records * 4);
+    const void *names = map_column(hunt_id, "users.dict", header.users * MAX_NAME_LEN);
+    if (user == MAP_FAILED || value == MAP_FAILED || names == MAP_FAILED) {
+        unmap_column(user, header.records * 4);
+        unmap_column(value, header.records * 4);
+        unmap_column(names, header.users * MAX_NAME_LEN);
+        return -1;
+    }
+
+    columns->records = header.records;
+    columns->users = header.users;
+    columns->user = user;
+    columns->value = value;
+    columns->names = names;
+    return 0;
+}
+
+void columns_close(ColumnSet *columns) {
+    unmap_column(columns->user, columns->records * 4);
+    unmap_column(columns->value, columns->records * 4);
+    unmap_column(columns->names, columns->users * MAX_NAME_LEN);
+    memset(columns, 0, sizeof(ColumnSet));
+}
+
+int columns_build(const char *hunt_id) {
+    char path[MAX_PATH_LEN];
+    snprintf(path, MAX_PATH_LEN, "hunts/%s/columns", hunt_id);
+    if (mkdir(path, 0777) == -1 && !have_columns(hunt_id)) {
+        return -1;
+    }
+    return columns_rebuild(hunt_id);
+}
+
+void columns_invalidate(const char *hunt_id) {
+    char meta_path[MAX_PATH_LEN];
+    column_path(hunt_id, "meta", meta_path);
+    remove(meta_path);
+}
+
+int columns_rebuild(const char *hunt_id) {
+    if (!have_columns(hunt_id)) {
+        return 0;
+    }
+
+    struct stat st;
+    TreasureMap map;
+    if (data_stat(hunt_id, &st) == -1 || treasure_map_open(hunt_id, &map) == -1) {
+        return -1;
+    }
+
+    // Invalidate first so readers never pair the old meta with new columns
+    columns_invalidate(hunt_id);
+
+    Dictionary dict = {0};
+    ColumnRows rows = {0};
+    int ok = 1;
+    const Treasure *treasure;
+    off_t offset;
+    while (ok && (treasure = treasure_map_next(&map, &offset)) != NULL) {
+        ok = rows_add_treasure(&rows, &dict, treasure, offset) == 0;
+    }
+
+    ColumnsHeader header = {0};
+    header.data_size = map.length;
+    header.data_inode = st.st_ino;
+    header.records = rows.count;
+    header.users = dict.count;
+    treasure_map_close(&map);
+
+    ok = ok && write_rows(hunt_id, &rows, 0, 1) == 0 && write_names(hunt_id, &dict, 0, 1) == 0 &&
+         write_header(hunt_id, &header) == 0;
+
+    rows_free(&rows);
+    dict_free(&dict);
+    return ok ? 0 : -1;
+}
+
+int columns_append(const char *hunt_id, const Treasure *records, const off_t *offsets, size_t count, off_t data_size) {
+    if (count == 0 || !have_columns(hunt_id)) {
+        return 0;
+    }
+
+    // Only extend columns that described the file exactly up to this append
+    ColumnsHeader header;
+    struct stat st;
+    Dictionary dict;
+    if (read_header(hunt_id, &header) == -1 || data_stat(hunt_id, &st) == -1 ||
+        header.data_inode != (uint64_t)st.st_ino || header.data_size != (uint64_t)offsets[0] ||
+        dict_load(hunt_id, header.users, &dict) == -1) {
+        return columns_rebuild(hunt_id);
+    }
+
+    ColumnRows rows = {0};
+    int ok = 1;
+    for (size_t i = 0; i < count && ok; i++) {
+        ok = rows_add_treasure(&rows, &dict, &records[i], offsets[i]) == 0;
+    }
+
+    // Columns and names first, then the header that makes them visible
+    ok = ok && write_rows(hunt_id, &rows, header.records, 0) == 0 &&
+         write_names(hunt_id, &dict, header.users, 0) == 0;
+    if (ok) {
+        header.records += count;
+        header.users = dict.count;
+        header.data_size = data_size;
+        ok = write_header(hunt_id, &header) == 0;
+    }
+
+    rows_free(&rows);
+    dict_free(&dict);
+    return ok ? 0 : columns_rebuild(hunt_id);
+}
+
+int columns_remove(const char *hunt_id, off_t offset) {
+    ColumnsHeader header;
+    if (!have_columns(hunt_id) || read_header(hunt_id, &header) == -1) {
+        return 0;
+    }
+
+    // Offsets increase with the record number, so binary search the column
+    const int64_t *offsets = map_column(hunt_id, column_files[COLUMN_OFFSET], header.records * 8);
+    if (offsets == MAP_FAILED) {
+        return -1;
+    }
+
+    size_t low = 0;
+    size_t high = header.records;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (offsets[mid] < offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    int found = low < header.records && offsets[low] == offset;
+    unmap_column(offsets, header.records * 8);
+
+    if (!found) {
+        return -1;
+    }
+
+    uint32_t dead = COLUMN_DEAD;
+    return write_at(hunt_id, column_files[COLUMN_USER], &dead, 4, (off_t)low * 4, 0);
+}
\ No newline at end of file
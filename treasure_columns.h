@@ -0,0 +1,59 @@
+#ifndef TREASURE_COLUMNS_H
+#define TREASURE_COLUMNS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "treasure.h"
+
+// Optional column-oriented copy of a hunt (hunts/<id>/columns/), one file per
+// field with one entry per record of treasures.dat, tombstones included:
+//
+//   user.u32    dictionary ID of the user, COLUMN_DEAD for removed records
+//   value.i32   treasure value
+//   lat.f32     latitude
+//   lon.f32     longitude
+//   offset.i64  byte offset of the record in treasures.dat
+//   users.dict  user names, MAX_NAME_LEN bytes each, in dictionary ID order
+//   meta        header naming the treasures.dat size and inode it describes
+//
+// Scans that only need users and values read 8 bytes per record instead of
+// the whole record. The columns exist once --build-columns has been run and
+// are then kept in sync by every treasure_manager write; readers ignore them
+// whenever the meta file does not match treasures.dat.
+
+#define COLUMN_DEAD UINT32_MAX
+
+typedef struct {
+    size_t records;
+    size_t users;
+    const uint32_t *user;
+    const int32_t *value;
+    const char (*names)[MAX_NAME_LEN];
+} ColumnSet;
+
+// Maps the user and value columns and the dictionary. Returns 0, or -1 when
+// the hunt has no columns or they are out of date.
+int columns_open(const char *hunt_id, ColumnSet *columns);
+
+void columns_close(ColumnSet *columns);
+
+// Creates the hunt's columns directory and fills it from treasures.dat
+int columns_build(const char *hunt_id);
+
+// Rewrites existing columns from treasures.dat; a no-op for hunts without them
+int columns_rebuild(const char *hunt_id);
+
+// Removes the meta file, so readers ignore the columns until the next write
+// that rebuilds them
+void columns_invalidate(const char *hunt_id);
+// Records treasures appended at offsets; data_size is the file size afterwards.
+// Falls back to a rebuild when the columns were not current before the append.
+int columns_append(const char *hunt_id, const Treasure *records, const off_t *offsets, size_t count, off_t data_size);
+
+// Marks the record at offset as removed, before its tombstone is applied.
+// Returns 0, or -1 if the record's row could not be marked; the caller must
+// then invalidate the columns, as a rebuild would still count the record.
+int columns_remove(const char *hunt_id, off_t offset);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "treasure_file.h"
+
+static void data_path(const char *hunt_id, char *path) {
+    snprintf(path, MAX_PATH_LEN, "hunts/%s/treasures.dat", hunt_id);
+}
+
+TreasureFormat treasure_file_detect(const void *data, size_t length) {
+    if (length >= sizeof(TreasureFileHeader) && memcmp(data, TREASURE_FILE_MAGIC, 4) == 0) {
+        return TREASURE_FORMAT_COMPACT;
+    }
+    return TREASURE_FORMAT_LEGACY;
+}
+
+size_t treasure_file_data_start(TreasureFormat format) {
+    return format == TREASURE_FORMAT_COMPACT ? sizeof(TreasureFileHeader) : 0;
+}
+
+TreasureFormat treasure_file_default_format() {
+    const char *format = getenv("TREASURE_FORMAT");
+    if (format && strcmp(format, "legacy") == 0) {
+        return TREASURE_FORMAT_LEGACY;
+    }
+    return TREASURE_FORMAT_COMPACT;
+}
+
+size_t treasure_file_encode(TreasureFormat format, const Treasure *treasure, char *out) {
+    if (format == TREASURE_FORMAT_LEGACY) {
+        memcpy(out, treasure, sizeof(Treasure));
+        return sizeof(Treasure);
+    }
+
+    size_t id_len = strnlen(treasure->id, MAX_ID_LEN - 1);
+    size_t user_len = strnlen(treasure->user, MAX_NAME_LEN - 1);
+    size_t clue_len = strnlen(treasure->clue, MAX_CLUE_LEN - 1);
+
+    unsigned char *p = (unsigned char *)out;
+    p[0] = treasure_is_live(treasure) ? 0 : COMPACT_FLAG_DELETED;
+    p[1] = id_len;
+    p[2] = user_len;
+    p[3] = clue_len;
+    memcpy(p + 4, &treasure->latitude, 4);
+    memcpy(p + 8, &treasure->longitude, 4);
+    memcpy(p + 12, &treasure->value, 4);
+
+    char *s = out + COMPACT_FIXED_LEN;
+    memcpy(s, treasure->id, id_len);
+    s += id_len;
+    memcpy(s, treasure->user, user_len);
+    s += user_len;
+    memcpy(s, treasure->clue, clue_len);
+    return COMPACT_FIXED_LEN + id_len + user_len + clue_len;
+}
+
+size_t treasure_file_decode(TreasureFormat format, const char *data, size_t available, Treasure *out) {
+    if (format == TREASURE_FORMAT_LEGACY) {
+        if (available < sizeof(Treasure)) {
+            return 0;
+        }
+        memcpy(out, data, sizeof(Treasure));
+        return sizeof(Treasure);
+    }
+
+    if (available < COMPACT_FIXED_LEN) {
+        return 0;
+    }
+
+    const unsigned char *p = (const unsigned char *)data;
+    size_t id_len = p[1];
+    size_t user_len = p[2];
+    size_t clue_len = p[3];
+    size_t length = COMPACT_FIXED_LEN + id_len + user_len + clue_len;
+    if (id_len >= MAX_ID_LEN || user_len >= MAX_NAME_LEN || clue_len >= MAX_CLUE_LEN || available < length) {
+        return 0;
+    }
+
+    memcpy(&out->latitude, p + 4, 4);
+    memcpy(&out->longitude, p + 8, 4);
+    memcpy(&out->value, p + 12, 4);
+
+    const char *s = data + COMPACT_FIXED_LEN;
+    memcpy(out->id, s, id_len);
+    out->id[id_len] = '\0';
+    s += id_len;
+    memcpy(out->user, s, user_len);
+    out->user[user_len] = '\0';
+    s += user_len;
+    memcpy(out->clue, s, clue_len);
+    out->clue[clue_len] = '\0';
+
+    if (p[0] & COMPACT_FLAG_DELETED) {
+        out->id[0] = '\0';
+    }
+    return length;
+}
+
+static void fill_header(TreasureFileHeader *header, uint64_t record_count) {
+    memset(header, 0, sizeof(TreasureFileHeader));
+    memcpy(header->magic, TREASURE_FILE_MAGIC, 4);
+    header->version = TREASURE_FILE_VERSION;
+    header->header_size = sizeof(TreasureFileHeader);
+    header->record_count = record_count;
+}
+
+int treasure_file_write_header(int fd, uint64_t record_count) {
+    TreasureFileHeader header;
+    fill_header(&header, record_count);
+    return pwrite(fd, &header, sizeof(header), 0) == sizeof(header) ? 0 : -1;
+}
+
+// Size and format of the hunt's file; a missing file is empty and takes the
+// default format
+static int current_layout(const char *path, off_t *size, TreasureFormat *format, TreasureFileHeader *header) {
+    struct stat st;
+    if (stat(path, &st) == -1) {
+        if (errno != ENOENT) {
+            return -1;
+        }
+        st.st_size = 0;
+    }
+    *size = st.st_size;
+    if (st.st_size == 0) {
+        *format = treasure_file_default_format();
+        return 0;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    ssize_t bytes = pread(fd, header, sizeof(TreasureFileHeader), 0);
+    close(fd);
+    *format = treasure_file_detect(header, bytes > 0 ? bytes : 0);
+    return 0;
+}
+
+int treasure_file_plan_append(const char *hunt_id, const Treasure *records, size_t count,
+                              TreasureWrite writes[2], off_t *offsets, off_t *end) {
+    char path[MAX_PATH_LEN];
+    data_path(hunt_id, path);
+
+    off_t size;
+    TreasureFormat format;
+    TreasureFileHeader header;
+    if (current_layout(path, &size, &format, &header) == -1) {
+        return -1;
+    }
+
+    // A new compact file starts with its header
+    size_t header_len = size == 0 && format == TREASURE_FORMAT_COMPACT ? sizeof(TreasureFileHeader) : 0;
+    size_t max_len = format == TREASURE_FORMAT_COMPACT ? COMPACT_MAX_LEN : sizeof(Treasure);
+    char *buffer = malloc(header_len + count * max_len);
+    if (!buffer) {
+        return -1;
+    }
+    if (header_len > 0) {
+        fill_header((TreasureFileHeader *)buffer, count);
+    }
+
+    size_t length = header_len;
+    for (size_t i = 0; i < count; i++) {
+        if (offsets) {
+            offsets[i] = size + length;
+        }
+        length += treasure_file_encode(format, &records[i], buffer + length);
+    }
+    writes[0].offset = size;
+    writes[0].data = buffer;
+    writes[0].length = length;
+    *end = size + length;
+
+    // The header's count is bookkeeping; readers walk records up to the file size
+    if (format != TREASURE_FORMAT_COMPACT || header_len > 0) {
+        return 1;
+    }
+    header.record_count += count;
+    writes[1].offset = 0;
+    writes[1].data = malloc(sizeof(TreasureFileHeader));
+    writes[1].length = sizeof(TreasureFileHeader);
+    if (!writes[1].data) {
+        free(buffer);
+        return -1;
+    }
+    memcpy(writes[1].data, &header, sizeof(TreasureFileHeader));
+    return 2;
+}
+
+int treasure_file_plan_tombstone(const char *hunt_id, off_t offset, TreasureWrite *write) {
+    char path[MAX_PATH_LEN];
+    data_path(hunt_id, path);
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+
+    TreasureFileHeader header;
+    ssize_t bytes = pread(fd, &header, sizeof(header), 0);
+    TreasureFormat format = treasure_file_detect(&header, bytes > 0 ? bytes : 0);
+
+    // Legacy records lose the first byte of their ID; compact ones get a flag
+    char byte = '\0';
+    off_t position = offset + offsetof(Treasure, id);
+    if (format == TREASURE_FORMAT_COMPACT) {
+        position = offset;
+        if (pread(fd, &byte, 1, position) != 1) {
+            close(fd);
+            return -1;
+        }
+        byte |= COMPACT_FLAG_DELETED;
+    }
+    close(fd);
+
+    write->offset = position;
+    write->length = 1;
+    write->data = malloc(1);
+    if (!write->data) {
+        return -1;
+    }
+    write->data[0] = byte;
+    return 0;
+}
+
+int treasure_file_apply(const char *hunt_id, const TreasureWrite *writes, size_t count) {
+    char path[MAX_PATH_LEN];
+    data_path(hunt_id, path);
+
+    int fd = open(path, O_WRONLY | O_CREAT, 0666);
+    if (fd == -1) {
+        return -1;
+    }
+
+    int ok = 1;
+    for (size_t i = 0; ok && i < count; i++) {
+        const char *p = writes[i].data;
+        size_t length = writes[i].length;
+        off_t offset = writes[i].offset;
+        while (ok && length > 0) {
+            ssize_t bytes = pwrite(fd, p, length, offset);
+            if (bytes == -1 && errno == EINTR) {
+                continue;
+            }
+            ok = bytes > 0;
+            if (ok) {
+                p += bytes;
+                length -= bytes;
+                offset += bytes;
+            }
+        }
+    }
+
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+void treasure_file_free_writes(TreasureWrite *writes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(writes[i].data);
+        writes[i].data = NULL;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#ifndef TREASURE_FILE_H
+#define TREASURE_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "treasure.h"
+
+// On-disk formats of hunts/<id>/treasures.dat.
+//
+// Legacy files are a bare array of Treasure structs with no header.
+//
+// Compact files start with a TreasureFileHeader and hold variable-length
+// records: a 16-byte fixed part followed by the id, user and clue bytes
+// (no terminators):
+//
+//   uint8 flags | uint8 id_len | uint8 user_len | uint8 clue_len
+//   float latitude | float longitude | int32 value | id | user | clue
+//
+// New hunts are written in the compact format unless TREASURE_FORMAT=legacy.
+// Compaction rewrites a hunt in that same default format, which is how legacy
+// hunts get converted.
+
+#define TREASURE_FILE_MAGIC "\x89TRS"
+#define TREASURE_FILE_VERSION 1
+#define COMPACT_FIXED_LEN 16
+#define COMPACT_MAX_LEN (COMPACT_FIXED_LEN + MAX_ID_LEN + MAX_NAME_LEN + MAX_CLUE_LEN)
+#define COMPACT_FLAG_DELETED 0x1
+
+typedef enum {
+    TREASURE_FORMAT_LEGACY,
+    TREASURE_FORMAT_COMPACT
+} TreasureFormat;
+
+typedef struct {
+    char magic[4];
+    uint16_t version;      // schema version of the records
+    uint16_t header_size;  // records start here
+    uint64_t record_count; // records appended so far, tombstones included
+} TreasureFileHeader;
+
+// Format of a file whose first bytes are data; empty files count as legacy.
+TreasureFormat treasure_file_detect(const void *data, size_t length);
+
+// Byte offset of the first record
+size_t treasure_file_data_start(TreasureFormat format);
+
+// Format used for new hunts and for compaction output
+TreasureFormat treasure_file_default_format();
+
+// Appends one record in the given format to out. Returns the bytes written.
+size_t treasure_file_encode(TreasureFormat format, const Treasure *treasure, char *out);
+
+// Decodes the record at data into *out (a tombstone decodes with an empty ID).
+// Returns the record's encoded length, or 0 if it is truncated or corrupt.
+size_t treasure_file_decode(TreasureFormat format, const char *data, size_t available, Treasure *out);
+
+// Writes a fresh header for a compact file holding record_count records
+int treasure_file_write_header(int fd, uint64_t record_count);
+
+// A write into treasures.dat: length bytes of data at offset
+typedef struct {
+    off_t offset;
+    char *data;
+    size_t length;
+} TreasureWrite;
+
+// Mutations are planned as writes first so they can be journaled before
+// being applied (see treasure_wal.h).
+
+// Plans appending records: writes[0] holds them encoded at the file's end,
+// preceded by a header when the file is new, and for an existing compact
+// file writes[1] updates the header's record count. offsets (optional, count
+// entries) receives each record's position and *end the file size
+// afterwards. Returns the number of writes, or -1.
+int treasure_file_plan_append(const char *hunt_id, const Treasure *records, size_t count,
+                              TreasureWrite writes[2], off_t *offsets, off_t *end);
+
+// Plans the one-byte write that marks the record at offset deleted
+int treasure_file_plan_tombstone(const char *hunt_id, off_t offset, TreasureWrite *write);
+
+// Performs writes in order, creating the file if needed. Returns 0 or -1.
+int treasure_file_apply(const char *hunt_id, const TreasureWrite *writes, size_t count);
+
+void treasure_file_free_writes(TreasureWrite *writes, size_t count);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "treasure_geo.h"
+#include "treasure_map.h"
+#include "treasure_lock.h"
+
+#define GEO_MAGIC "TGEO"
+#define GEO_VERSION 1
+#define GEO_ROWS 18000    // 180 degrees of latitude
+#define GEO_COLUMNS 36000 // 360 degrees of longitude
+#define EARTH_RADIUS_KM 6371.0
+
+// On-disk header, followed by `sorted` entries in cell order, then `tail`
+// entries in append order
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t data_size;  // size of treasures.dat the index describes
+    uint64_t data_inode; // inode of treasures.dat, catches replaced files
+    uint64_t sorted;
+    uint64_t tail;
+} GeoHeader;
+
+typedef struct {
+    uint64_t cell;
+    float latitude;
+    float longitude;
+    int64_t offset;
+} GeoEntry;
+
+// A query region: a box, optionally narrowed to a circle around center
+typedef struct {
+    double min_lat;
+    double min_lon;
+    double max_lat;
+    double max_lon;
+    int circle;
+    double lat;
+    double lon;
+    double radius_km;
+} GeoRegion;
+
+typedef struct {
+    GeoMatch *items;
+    size_t count;
+    size_t capacity;
+} MatchList;
+
+static void build_paths(const char *hunt_id, char *data_path, char *geo_path) {
+    snprintf(data_path, MAX_PATH_LEN, "hunts/%s/treasures.dat", hunt_id);
+    snprintf(geo_path, MAX_PATH_LEN, "hunts/%s/treasures.geo", hunt_id);
+}
+
+static long grid_row(double lat) {
+    long row = (long)floor((lat + 90.0) / GEO_CELL_DEGREES);
+    return row < 0 ? 0 : row >= GEO_ROWS ? GEO_ROWS - 1 : row;
+}
+
+static long grid_column(double lon) {
+    long column = (long)floor((lon + 180.0) / GEO_CELL_DEGREES);
+    return column < 0 ? 0 : column >= GEO_COLUMNS ? GEO_COLUMNS - 1 : column;
+}
+
+static uint64_t cell_of(double lat, double lon) {
+    return (uint64_t)grid_row(lat) * GEO_COLUMNS + grid_column(lon);
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const GeoEntry *x = a;
+    const GeoEntry *y = b;
+    if (x->cell != y->cell) {
+        return x->cell < y->cell ? -1 : 1;
+    }
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+double geo_distance_km(double lat1, double lon1, double lat2, double lon2) {
+    // Haversine
+    double to_radians = M_PI / 180.0;
+    double dlat = (lat2 - lat1) * to_radians;
+    double dlon = (lon2 - lon1) * to_radians;
+    double a = sin(dlat / 2) * sin(dlat / 2) +
+               cos(lat1 * to_radians) * cos(lat2 * to_radians) * sin(dlon / 2) * sin(dlon / 2);
+    return 2 * EARTH_RADIUS_KM * asin(sqrt(a < 1 ? a : 1));
+}
+
+// Sorts entries and replaces treasures.geo with them in one rename
+static int write_index(const char *hunt_id, GeoEntry *entries, size_t count, uint64_t data_size, uint64_t data_inode) {
+    char data_path[MAX_PATH_LEN];
+    char geo_path[MAX_PATH_LEN];
+    char temp_path[MAX_PATH_LEN];
+    build_paths(hunt_id, data_path, geo_path);
+
+    qsort(entries, count, sizeof(GeoEntry), compare_entries);
+
+    GeoHeader header = {0};
+    memcpy(header.magic, GEO_MAGIC, 4);
+    header.version = GEO_VERSION;
+    header.data_size = data_size;
+    header.data_inode = data_inode;
+    header.sorted = count;
+
+    int fd = temp_file_create(geo_path, temp_path);
+    if (fd == -1) {
+        return -1;
+    }
+    size_t length = count * sizeof(GeoEntry);
+    int ok = write(fd, &header, sizeof(header)) == sizeof(header) &&
+             (length == 0 || write(fd, entries, length) == (ssize_t)length);
+    close(fd);
+
+    if (!ok || rename(temp_path, geo_path) == -1) {
+        remove(temp_path);
+        return -1;
+    }
+    return 0;
+}
+
+int geo_rebuild(const char *hunt_id) {
+    char data_path[MAX_PATH_LEN];
+    char geo_path[MAX_PATH_LEN];
+    build_paths(hunt_id, data_path, geo_path);
+
+    struct stat st;
+    TreasureMap map;
+    if (stat(data_path, &st) == -1 || treasure_map_open(hunt_id, &map) == -1) {
+        return -1;
+    }
+
+    GeoEntry *entries = malloc((map.count + 1) * sizeof(GeoEntry));
+    size_t capacity = map.count + 1;
+    size_t count = 0;
+    const Treasure *treasure;
+    off_t offset;
+    while (entries && (treasure = treasure_map_next(&map, &offset)) != NULL) {
+        if (!treasure_is_live(treasure)) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            GeoEntry *grown = realloc(entries, capacity * sizeof(GeoEntry));
+            if (!grown) {
+                free(entries);
+                entries = NULL;
+                break;
+            }
+            entries = grown;
+        }
+        entries[count].cell = cell_of(treasure->latitude, treasure->longitude);
+        entries[count].latitude = treasure->latitude;
+        entries[count].longitude = treasure->longitude;
+        entries[count].offset = offset;
+        count++;
+    }
+
+    uint64_t data_size = map.length;
+    treasure_map_close(&map);
+    if (!entries) {
+        return -1;
+    }
+
+    int result = write_index(hunt_id, entries, count, data_size, st.st_ino);
+    free(entries);
+    return result;
+}
+
+// Opens treasures.geo if it describes the current treasures.dat file (the
+// caller compares header->data_size, which differs mid-append)
+static int open_fresh(const char *hunt_id, int flags, GeoHeader *header, off_t *data_size) {
+    char data_path[MAX_PATH_LEN];
+    char geo_path[MAX_PATH_LEN];
+    build_paths(hunt_id, data_path, geo_path);
+
+    struct stat st;
+    if (stat(data_path, &st) == -1) {
+        return -1;
+    }
+    *data_size = st.st_size;
+
+    int fd = open(geo_path, flags);
+    if (fd == -1) {
+        return -1;
+    }
+    if (pread(fd, header, sizeof(GeoHeader), 0) != sizeof(GeoHeader) ||
+        memcmp(header->magic, GEO_MAGIC, 4) != 0 || header->version != GEO_VERSION ||
+        header->data_inode != (uint64_t)st.st_ino || header->tail > GEO_MAX_TAIL) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int geo_add(const char *hunt_id, const Treasure *records, const off_t *offsets, size_t count, off_t data_size) {
+    if (count == 0) {
+        return 0;
+    }
+
+    GeoHeader header;
+    off_t current_size;
+    int fd = open_fresh(hunt_id, O_RDWR, &header, &current_size);
+    if (fd == -1 || header.data_size != (uint64_t)offsets[0]) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return geo_rebuild(hunt_id);
+    }
+
+    GeoEntry *added = malloc(count * sizeof(GeoEntry));
+    if (!added) {
+        close(fd);
+        return -1;
+    }
+
+    size_t added_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!treasure_is_live(&records[i])) {
+            continue;
+        }
+        GeoEntry *entry = &added[added_count++];
+        entry->cell = cell_of(records[i].latitude, records[i].longitude);
+        entry->latitude = records[i].latitude;
+        entry->longitude = records[i].longitude;
+        entry->offset = offsets[i];
+    }
+
+    size_t existing = header.sorted + header.tail;
+    int ok;
+    if (header.tail + added_count <= GEO_MAX_TAIL) {
+        // Common case: extend the unsorted tail in place
+        size_t length = added_count * sizeof(GeoEntry);
+        ok = pwrite(fd, added, length, sizeof(GeoHeader) + existing * sizeof(GeoEntry)) == (ssize_t)length;
+        header.tail += added_count;
+        header.data_size = data_size;
+        ok = ok && pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+        close(fd);
+    } else {
+        // Tail full: merge everything into a new sorted file
+        size_t length = existing * sizeof(GeoEntry);
+        GeoEntry *entries = malloc(length + added_count * sizeof(GeoEntry));
+        ok = entries && pread(fd, entries, length, sizeof(GeoHeader)) == (ssize_t)length;
+        close(fd);
+        if (ok) {
+            memcpy(entries + existing, added, added_count * sizeof(GeoEntry));
+            ok = write_index(hunt_id, entries, existing + added_count, data_size, header.data_inode) == 0;
+        }
+        free(entries);
+    }
+
+    free(added);
+    return ok ? 0 : geo_rebuild(hunt_id);
+}
+
+static int add_match(MatchList *list, int64_t offset, double distance) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        GeoMatch *items = realloc(list->items, capacity * sizeof(GeoMatch));
+        if (!items) {
+            return -1;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count].offset = offset;
+    list->items[list->count].distance = distance;
+    list->count++;
+    return 0;
+}
+
+static int entry_matches(const GeoEntry *entry, const GeoRegion *region, double *distance) {
+    if (entry->latitude < region->min_lat || entry->latitude > region->max_lat ||
+        entry->longitude < region->min_lon || entry->longitude > region->max_lon) {
+        return 0;
+    }
+    *distance = 0;
+    if (region->circle) {
+        *distance = geo_distance_km(region->lat, region->lon, entry->latitude, entry->longitude);
+        return *distance <= region->radius_km;
+    }
+    return 1;
+}
+
+// First sorted entry whose cell is >= key
+static size_t lower_bound(const GeoEntry *entries, size_t count, uint64_t key) {
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (entries[mid].cell < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Collects matches for a region that does not wrap: one binary search per
+// grid row, then a pass over the bounded tail
+static int scan_region(const GeoEntry *entries, const GeoHeader *header, const GeoRegion *region, MatchList *list) {
+    long first_column = grid_column(region->min_lon);
+    long last_column = grid_column(region->max_lon);
+    double distance;
+
+    for (long row = grid_row(region->min_lat); row <= grid_row(region->max_lat); row++) {
+        uint64_t last = (uint64_t)row * GEO_COLUMNS + last_column;
+        for (size_t i = lower_bound(entries, header->sorted, (uint64_t)row * GEO_COLUMNS + first_column);
+             i < header->sorted && entries[i].cell <= last; i++) {
+            if (entry_matches(&entries[i], region, &distance) && add_match(list, entries[i].offset, distance) == -1) {
+                return -1;
+            }
+        }
+    }
+
+    for (size_t i = header->sorted; i < header->sorted + header->tail; i++) {
+        if (entry_matches(&entries[i], region, &distance) && add_match(list, entries[i].offset, distance) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Maps a fresh index (rebuilding a stale one) and runs the region, split in
+// two when it wraps across the antimeridian
+static int query(const char *hunt_id, GeoRegion region, GeoMatch **matches, size_t *count) {
+    *matches = NULL;
+    *count = 0;
+
+    GeoHeader header;
+    off_t data_size;
+    int fd = -1;
+    for (int attempt = 0; attempt < 2 && fd == -1; attempt++) {
+        fd = open_fresh(hunt_id, O_RDONLY, &header, &data_size);
+        if (fd != -1 && header.data_size != (uint64_t)data_size) {
+            close(fd);
+            fd = -1;
+        }
+        if (fd == -1 && (attempt > 0 || geo_rebuild(hunt_id) == -1)) {
+            return -1;
+        }
+    }
+
+    // A file shorter than its header claims would fault once mapped
+    struct stat st;
+    size_t length = sizeof(GeoHeader) + (header.sorted + header.tail) * sizeof(GeoEntry);
+    void *base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= length) {
+        base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+    const GeoEntry *entries = (const GeoEntry *)((const char *)base + sizeof(GeoHeader));
+
+    MatchList list = {0};
+    int result;
+    if (region.min_lon > region.max_lon) {
+        GeoRegion east = region;
+        GeoRegion west = region;
+        east.max_lon = 180.0;
+        west.min_lon = -180.0;
+        result = scan_region(entries, &header, &east, &list) == 0 ? scan_region(entries, &header, &west, &list) : -1;
+    } else {
+        result = scan_region(entries, &header, &region, &list);
+    }
+    munmap(base, length);
+
+    if (result == -1) {
+        free(list.items);
+        return -1;
+    }
+    *matches = list.items;
+    *count = list.count;
+    return 0;
+}
+
+int geo_query_box(const char *hunt_id, double min_lat, double min_lon, double max_lat, double max_lon,
+                  GeoMatch **matches, size_t *count) {
+    GeoRegion region = {min_lat, min_lon, max_lat, max_lon, 0, 0, 0, 0};
+    return query(hunt_id, region, matches, count);
+}
+
+static int compare_distance(const void *a, const void *b) {
+    const GeoMatch *x = a;
+    const GeoMatch *y = b;
+    if (x->distance != y->distance) {
+        return x->distance < y->distance ? -1 : 1;
+    }
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+int geo_query_near(const char *hunt_id, double lat, double lon, double radius_km,
+                   GeoMatch **matches, size_t *count) {
+    // Bounding box of the circle; it spans every longitude once it reaches a pole
+    double angle = radius_km / EARTH_RADIUS_KM;
+    double dlat = angle * 180.0 / M_PI;
+    GeoRegion region = {lat - dlat, -180.0, lat + dlat, 180.0, 1, lat, lon, radius_km};
+
+    if (region.min_lat > -90.0 && region.max_lat < 90.0) {
+        double ratio = sin(angle) / cos(lat * M_PI / 180.0);
+        double dlon = ratio < 1.0 ? asin(ratio) * 180.0 / M_PI : 180.0;
+        if (dlon < 180.0) {
+            region.min_lon = lon - dlon;
+            region.max_lon = lon + dlon;
+            if (region.min_lon < -180.0) {
+                region.min_lon += 360.0;
+            }
+            if (region.max_lon > 180.0) {
+                region.max_lon -= 360.0;
+            }
+        }
+    }
+
+    if (query(hunt_id, region, matches, count) == -1) {
+        return -1;
+    }
+    qsort(*matches, *count, sizeof(GeoMatch), compare_distance);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef TREASURE_GEO_H
+#define TREASURE_GEO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "treasure.h"
+
+// Spatial index of a hunt (hunts/<id>/treasures.geo). Records are bucketed
+// into a fixed grid of GEO_CELL_DEGREES cells numbered row by row, and the
+// entries {cell, latitude, longitude, offset} are kept sorted by cell, so a
+// query binary searches one contiguous key range per grid row it covers.
+// Appends land in a short unsorted tail that is merged once it reaches
+// GEO_MAX_TAIL entries. Like treasures.idx, the file remembers the size and
+// inode of treasures.dat and is rebuilt when they no longer match.
+//
+// Removed treasures keep their entries until the next rebuild; callers check
+// the records they resolve.
+
+#define GEO_CELL_DEGREES 0.01
+#define GEO_MAX_TAIL 256
+
+typedef struct {
+    off_t offset;    // record position in treasures.dat
+    double distance; // kilometres from the query point (0 for box queries)
+} GeoMatch;
+
+// Finds records inside the box, inclusive. A box with min_lon > max_lon wraps
+// across the antimeridian. *matches is malloc'd; returns 0 or -1 on error.
+int geo_query_box(const char *hunt_id, double min_lat, double min_lon, double max_lat, double max_lon,
+                  GeoMatch **matches, size_t *count);
+
+// Finds records within radius_km of a point, nearest first
+int geo_query_near(const char *hunt_id, double lat, double lon, double radius_km,
+                   GeoMatch **matches, size_t *count);
+
+// Records treasures appended at offsets; data_size is the file size afterwards
+int geo_add(const char *hunt_id, const Treasure *records, const off_t *offsets, size_t count, off_t data_size);
+
+// Rescans treasures.dat and rewrites the spatial index from scratch
+int geo_rebuild(const char *hunt_id);
+
+// Great-circle distance in kilometres
+double geo_distance_km(double lat1, double lon1, double lat2, double lon2);
+
+#endif
\ No newline at end of file
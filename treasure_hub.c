@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -8,17 +9,32 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
 #include "treasure.h"
+#include "treasure_protocol.h"
+#include "treasure_score.h"
+#include "treasure_ring.h"
+#include "treasure_scorer.h"
 
 #define MAX_CMD_LEN 256
 #define MAX_HUNT_ID_LEN 50
-#define COMMAND_FILE "/tmp/treasure_monitor_cmd"
-#define OUTPUT_PIPE "/tmp/treasure_monitor_output"
+#define MAX_PIPELINED 64
+#define CONNECT_TIMEOUT_MS 2000
+#define SCORE_ATTEMPTS 2 // tries per hunt when scorer workers die
 
 pid_t monitor_pid = 0;
 int monitor_active = 0;
+int monitor_fd = -1;
+Ring *monitor_ring = NULL; // replies arrive here when the monitor attached it
+uint32_t next_request_id = 1;
+ScorerPool scorers = { NULL, 0 }; // started on first use, sized by --procs
 
 void handle_sigchld(int sig) {
+    // Scorer workers are reaped by the pool, so only the monitor is waited for
+    if (monitor_pid <= 0) {
+        return;
+    }
     int status;
     pid_t pid = waitpid(monitor_pid, &status, WNOHANG);
     if (pid == monitor_pid) {
@@ -36,35 +52,135 @@ void setup_signal_handlers() {
     sigaction(SIGCHLD, &sa, NULL);
 }
 
-void send_command_to_monitor(const char *cmd) {
-    int fd = open(COMMAND_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-    if (fd == -1) {
-        perror("open command file");
-        return;
+// Opens the connection to the monitor, which lasts until it is stopped or
+// hangs up. Returns 0 or -1.
+int connect_monitor() {
+    monitor_fd = protocol_connect(MONITOR_SOCKET, CONNECT_TIMEOUT_MS);
+    if (monitor_fd == -1) {
+        return -1;
     }
-    write(fd, cmd, strlen(cmd));
-    close(fd);
 
-    if (kill(monitor_pid, SIGUSR1) == -1) {
-        perror("kill");
+    // Replies then come through shared memory; a refusal leaves them on the socket
+    monitor_ring = ring_connect(monitor_fd, next_request_id++);
+    return 0;
+}
+
+void disconnect_monitor() {
+    ring_destroy(monitor_ring);
+    monitor_ring = NULL;
+    if (monitor_fd != -1) {
+        close(monitor_fd);
+        monitor_fd = -1;
+    }
+}
+
+// Sends a command without waiting for its reply. Returns the request ID, or 0 on failure.
+uint32_t send_command_to_monitor(const char *cmd) {
+    uint32_t request_id = next_request_id++;
+    if (frame_send(monitor_fd, request_id, 0, cmd, strlen(cmd)) == -1) {
+        perror("send command");
+        return 0;
     }
+    return request_id;
 }
 
-void read_monitor_output() {
-    int fd = open(OUTPUT_PIPE, O_RDONLY);
-    if (fd == -1) {
-        perror("open output pipe");
+// Collects the replies to a batch of pipelined requests. Replies are printed in
+// request order, each one as soon as it and all earlier ones have arrived.
+void read_monitor_output(const uint32_t *request_ids, int count) {
+    typedef struct {
+        char *data;
+        size_t length;
+        int done;
+    } PendingReply;
+
+    PendingReply *replies = calloc(count, sizeof(PendingReply));
+    if (!replies) {
+        perror("calloc");
         return;
     }
 
-    char buffer[1024];
-    ssize_t bytes;
-    while ((bytes = read(fd, buffer, sizeof(buffer)-1)) > 0) {
-        buffer[bytes] = '\0';
-        printf("%s", buffer);
+    int next_to_print = 0;
+    while (next_to_print < count) {
+        // Ring frames are read in place; socket frames arrive in a buffer of their own
+        FrameHeader header;
+        RingSlice slices[2] = { { NULL, 0 }, { NULL, 0 } };
+        char *payload = NULL;
+        int result = monitor_ring ? ring_recv_frame(monitor_ring, &header, slices, monitor_fd)
+                                  : frame_recv(monitor_fd, &header, &payload);
+        if (result == 1 && payload) {
+            slices[0].data = payload;
+            slices[0].length = header.length;
+        }
+        if (result != 1) {
+            if (result == 0) {
+                printf("Monitor closed the connection\n");
+                // It hangs up on a reply it could not finish; the next
+                // command goes out on a new connection
+                disconnect_monitor();
+                if (monitor_active && connect_monitor() == -1) {
+                    perror("reconnect to monitor");
+                }
+            } else {
+                perror("read reply");
+            }
+            break;
+        }
+
+        int slot = -1;
+        for (int i = next_to_print; i < count; i++) {
+            if (request_ids[i] == header.request_id) {
+                slot = i;
+                break;
+            }
+        }
+
+        if (slot == next_to_print) {
+            fwrite(slices[0].data, 1, slices[0].length, stdout);
+            fwrite(slices[1].data, 1, slices[1].length, stdout);
+        } else if (slot != -1) {
+            char *grown = realloc(replies[slot].data, replies[slot].length + header.length);
+            if (grown) {
+                memcpy(grown + replies[slot].length, slices[0].data, slices[0].length);
+                memcpy(grown + replies[slot].length + slices[0].length, slices[1].data, slices[1].length);
+                replies[slot].data = grown;
+                replies[slot].length += header.length;
+            }
+        }
+        if (monitor_ring) {
+            ring_consume(monitor_ring, &header);
+        } else {
+            free(payload);
+        }
+
+        if (slot != -1 && (header.flags & FRAME_END)) {
+            replies[slot].done = 1;
+        }
+
+        // Flush every reply that is now at the head of the queue
+        while (next_to_print < count && replies[next_to_print].done) {
+            next_to_print++;
+            if (next_to_print < count && replies[next_to_print].length > 0) {
+                fwrite(replies[next_to_print].data, 1, replies[next_to_print].length, stdout);
+                free(replies[next_to_print].data);
+                replies[next_to_print].data = NULL;
+                replies[next_to_print].length = 0;
+            }
+        }
     }
 
-    close(fd);
+    fflush(stdout);
+    for (int i = 0; i < count; i++) {
+        free(replies[i].data);
+    }
+    free(replies);
+}
+
+// Sends one command and waits for its reply
+void run_monitor_command(const char *cmd) {
+    uint32_t request_id = send_command_to_monitor(cmd);
+    if (request_id != 0) {
+        read_monitor_output(&request_id, 1);
+    }
 }
 
 void start_monitor() {
@@ -86,6 +202,12 @@ void start_monitor() {
     } else {
         monitor_pid = pid;
         monitor_active = 1;
+
+        if (connect_monitor() == -1) {
+            perror("connect to monitor");
+            kill(pid, SIGTERM);
+            return;
+        }
         printf("Monitor started with PID: %d\n", pid);
     }
 }
@@ -100,6 +222,8 @@ void stop_monitor() {
     if (kill(monitor_pid, SIGTERM) == -1) {
         perror("kill");
     }
+
+    disconnect_monitor();
 }
 
 void list_hunts() {
@@ -108,22 +232,29 @@ void list_hunts() {
         return;
     }
 
-    send_command_to_monitor("list_hunts");
-    usleep(100000); // Small delay to allow monitor to process
-    read_monitor_output();
+    run_monitor_command("list_hunts");
 }
 
-void list_treasures(const char *hunt_id) {
+// Takes one or more space-separated hunt IDs and pipelines one request per hunt
+void list_treasures(char *hunt_ids) {
     if (!monitor_active) {
         printf("No monitor is currently running\n");
         return;
     }
 
-    char cmd[MAX_CMD_LEN];
-    snprintf(cmd, sizeof(cmd), "list_treasures %s", hunt_id);
-    send_command_to_monitor(cmd);
-    usleep(100000);
-    read_monitor_output();
+    uint32_t request_ids[MAX_PIPELINED];
+    int count = 0;
+
+    for (char *hunt_id = strtok(hunt_ids, " "); hunt_id && count < MAX_PIPELINED; hunt_id = strtok(NULL, " ")) {
+        char cmd[MAX_CMD_LEN];
+        snprintf(cmd, sizeof(cmd), "list_treasures %s", hunt_id);
+        uint32_t request_id = send_command_to_monitor(cmd);
+        if (request_id != 0) {
+            request_ids[count++] = request_id;
+        }
+    }
+
+    read_monitor_output(request_ids, count);
 }
 
 void view_treasure(const char *hunt_id, const char *treasure_id) {
@@ -134,69 +265,351 @@ void view_treasure(const char *hunt_id, const char *treasure_id) {
 
     char cmd[MAX_CMD_LEN];
     snprintf(cmd, sizeof(cmd), "view_treasure %s %s", hunt_id, treasure_id);
-    send_command_to_monitor(cmd);
-    usleep(100000);
-    read_monitor_output();
+    run_monitor_command(cmd);
 }
 
-void calculate_score(const char *hunt_id) {
-    printf("Calculating scores for hunt: %s\n", hunt_id);
-
-    int pipefd[2];
-    if (pipe(pipefd) == -1) {
-        perror("pipe");
+// Lists a user's treasures across all hunts, from the monitor's user index
+void by_user(const char *user) {
+    if (!monitor_active) {
+        printf("No monitor is currently running\n");
         return;
     }
 
-    pid_t pid = fork();
-    if (pid == -1) {
-        perror("fork");
+    char cmd[MAX_CMD_LEN];
+    snprintf(cmd, sizeof(cmd), "by_user %s", user);
+    run_monitor_command(cmd);
+}
+
+// Forwards a near_treasures or bbox_treasures query; args are the hunt ID
+// and coordinates exactly as typed
+void query_treasures(const char *command, const char *args) {
+    if (!monitor_active) {
+        printf("No monitor is currently running\n");
         return;
     }
 
-    if (pid == 0) { // Child process
-        close(pipefd[0]); // Close read end
-        dup2(pipefd[1], STDOUT_FILENO); // Redirect stdout to pipe
-        close(pipefd[1]);
+    char cmd[MAX_CMD_LEN];
+    snprintf(cmd, sizeof(cmd), "%s %s", command, args);
+    run_monitor_command(cmd);
+}
 
-        execl("./calculate_score", "calculate_score", hunt_id, NULL);
-        perror("execl");
-        exit(EXIT_FAILURE);
-    } else { // Parent process
-        close(pipefd[1]); // Close write end
+void calculate_score(const char *hunt_id, int top) {
+    printf("Calculating scores for hunt: %s\n", hunt_id);
 
-        char buffer[1024];
-        ssize_t bytes;
+    // A running monitor keeps the totals up to date, so nothing is rescanned
+    if (monitor_active) {
+        char cmd[MAX_CMD_LEN];
+        snprintf(cmd, sizeof(cmd), "calculate_score %s --top %d", hunt_id, top);
         printf("Score results:\n");
-        while ((bytes = read(pipefd[0], buffer, sizeof(buffer)-1)) > 0) {
-            buffer[bytes] = '\0';
-            printf("%s", buffer);
-        }
+        run_monitor_command(cmd);
+        return;
+    }
 
-        close(pipefd[0]);
-        waitpid(pid, NULL, 0);
+    // Otherwise a resident worker scores it, and scores it again if it died
+    if (scorers.count == 0 && scorer_pool_resize(&scorers, 1) == -1) {
+        return;
     }
-}
+    Scorer *worker = &scorers.workers[0];
+    printf("Score results:\n");
+    fflush(stdout); // the worker's errors go straight to stderr
 
-void calculate_all_scores() {
-    DIR *dir;
-    struct dirent *entry;
+    int result = -1;
+    for (int attempt = 0; attempt < SCORE_ATTEMPTS && result == -1; attempt++) {
+        if (scorer_submit(worker, hunt_id, top) == -1) {
+            break;
+        }
+        result = scorer_collect(worker);
+    }
+    if (result == 0) {
+        score_result_print(hunt_id, worker->result_fd, stdout);
+    } else if (result == -1) {
+        fprintf(stderr, "Error: Could not score hunt %s\n", hunt_id);
+    }
+}
 
-    dir = opendir("hunts");
+// One hunt's share of calculate_all_scores; the report is filled in by
+// whichever worker or child process scores it
+typedef struct {
+    char hunt_id[MAX_PATH_LEN];
+    char *report;
+    size_t report_len;
+} ScoreJob;
+
+typedef struct {
+    ScoreJob *jobs;
+    size_t count;
+    size_t next;
+    int top;
+    pthread_mutex_t lock;
+} ScoreQueue;
+
+// Lists every hunt directory. Returns the number of jobs, or -1 on error.
+ssize_t collect_score_jobs(ScoreJob **jobs) {
+    DIR *dir = opendir("hunts");
     if (dir == NULL) {
         perror("opendir");
-        return;
+        return -1;
     }
 
+    size_t count = 0;
+    size_t capacity = 0;
+    *jobs = NULL;
+
+    struct dirent *entry;
     while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+        // Hunts are the directories; the catalog and dot entries are not
+        if (entry->d_name[0] == '.' || (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN)) {
             continue;
         }
 
-        calculate_score(entry->d_name);
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            ScoreJob *grown = realloc(*jobs, capacity * sizeof(ScoreJob));
+            if (!grown) {
+                perror("realloc");
+                break;
+            }
+            *jobs = grown;
+        }
+
+        ScoreJob *job = &(*jobs)[count++];
+        memset(job, 0, sizeof(ScoreJob));
+        snprintf(job->hunt_id, sizeof(job->hunt_id), "%s", entry->d_name);
     }
 
     closedir(dir);
+    return count;
+}
+
+void *score_worker(void *arg) {
+    ScoreQueue *queue = arg;
+
+    while (1) {
+        pthread_mutex_lock(&queue->lock);
+        size_t i = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if (i >= queue->count) {
+            break;
+        }
+
+        ScoreJob *job = &queue->jobs[i];
+        FILE *out = open_memstream(&job->report, &job->report_len);
+        if (!out) {
+            continue;
+        }
+
+        ScoreTable table;
+        if (score_hunt(job->hunt_id, &table) == 0) {
+            score_table_rank(&table, queue->top);
+            score_table_print(job->hunt_id, &table, out);
+            score_table_free(&table);
+        } else {
+            fprintf(out, "Error: Could not open treasures file for hunt %s\n", job->hunt_id);
+        }
+        fclose(out);
+    }
+
+    return NULL;
+}
+
+// Scores every hunt in this process on a pool with one thread per core
+void score_with_threads(ScoreJob *jobs, size_t count, int top) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t workers = cores > 0 ? (size_t)cores : 1;
+    if (workers > count) {
+        workers = count;
+    }
+
+    ScoreQueue queue = { jobs, count, 0, top, PTHREAD_MUTEX_INITIALIZER };
+    pthread_t *threads = malloc(workers * sizeof(pthread_t));
+    if (!threads) {
+        perror("malloc");
+        return;
+    }
+
+    size_t started = 0;
+    for (; started < workers; started++) {
+        if (pthread_create(&threads[started], NULL, score_worker, &queue) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        score_worker(&queue); // no threads available, score inline
+    }
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+// Renders the results a worker left in result_fd at the end of job's report
+void append_scores(ScoreJob *job, int result_fd) {
+    char *scores = NULL;
+    size_t scores_len = 0;
+    FILE *out = open_memstream(&scores, &scores_len);
+    if (!out) {
+        return;
+    }
+    score_result_print(job->hunt_id, result_fd, out);
+    fclose(out);
+    char *grown = realloc(job->report, job->report_len + scores_len + 1);
+    if (grown) {
+        memcpy(grown + job->report_len, scores, scores_len + 1);
+        job->report_len += scores_len;
+        job->report = grown;
+    }
+    free(scores);
+}
+
+// Scores every hunt on the resident calculate_score workers, with the pool
+// sized to max_procs, handing each worker the next hunt as soon as it is idle.
+// A hunt that could not be submitted or whose worker died is queued again,
+// up to SCORE_ATTEMPTS times in all, and reported as an error after that.
+void score_with_processes(ScoreJob *jobs, size_t count, int max_procs, int top) {
+    if (scorer_pool_resize(&scorers, max_procs) == -1) {
+        return;
+    }
+    size_t workers = scorers.count;
+    struct pollfd *fds = malloc(workers * sizeof(struct pollfd));
+    size_t *polled = malloc(workers * sizeof(size_t));
+    size_t *owners = malloc(workers * sizeof(size_t));
+    size_t *queue = malloc(count * SCORE_ATTEMPTS * sizeof(size_t));
+    int *attempts = calloc(count, sizeof(int));
+    if (!fds || !polled || !owners || !queue || !attempts) {
+        perror("malloc");
+        free(fds);
+        free(polled);
+        free(owners);
+        free(queue);
+        free(attempts);
+        return;
+    }
+
+    size_t head = 0;
+    size_t tail = 0;
+    for (size_t i = 0; i < count; i++) {
+        queue[tail++] = i;
+    }
+    for (size_t i = 0; i < workers; i++) {
+        owners[i] = SIZE_MAX; // idle
+    }
+    size_t running = 0;
+
+    while (head < tail || running > 0) {
+        for (size_t i = 0; i < workers && head < tail; i++) {
+            if (owners[i] != SIZE_MAX) {
+                continue;
+            }
+            size_t job = queue[head++];
+            attempts[job]++;
+            if (scorer_submit(&scorers.workers[i], jobs[job].hunt_id, top) == 0) {
+                owners[i] = job;
+                running++;
+            } else if (attempts[job] < SCORE_ATTEMPTS) {
+                queue[tail++] = job;
+            } else {
+                fprintf(stderr, "Error: Could not score hunt %s\n", jobs[job].hunt_id);
+            }
+        }
+        if (running == 0) {
+            continue; // nothing could be submitted, so there is nothing to wait for
+        }
+
+        nfds_t count_fds = 0;
+        for (size_t i = 0; i < workers; i++) {
+            if (owners[i] != SIZE_MAX) {
+                fds[count_fds].fd = scorers.workers[i].sock;
+                fds[count_fds].events = POLLIN;
+                polled[count_fds++] = i;
+            }
+        }
+        if (poll(fds, count_fds, -1) == -1) {
+            continue; // EINTR from SIGCHLD
+        }
+
+        for (nfds_t j = 0; j < count_fds; j++) {
+            if (!fds[j].revents) {
+                continue;
+            }
+            size_t i = polled[j];
+            size_t job = owners[i];
+            int result = scorer_collect(&scorers.workers[i]);
+            if (result == 0) {
+                append_scores(&jobs[job], scorers.workers[i].result_fd);
+            } else if (result == -1 && attempts[job] < SCORE_ATTEMPTS) {
+                queue[tail++] = job;
+            } else if (result == -1) {
+                fprintf(stderr, "Error: Could not score hunt %s\n", jobs[job].hunt_id);
+            }
+            owners[i] = SIZE_MAX;
+            running--;
+        }
+    }
+
+    free(fds);
+    free(polled);
+    free(owners);
+    free(queue);
+    free(attempts);
+}
+
+// Scores all hunts and prints one merged report in directory order. Without
+// --procs (max_procs == 0), a running monitor answers from its maintained
+// totals and otherwise the in-process thread pool scores the hunts. With
+// --procs n the hunts go to the resident calculate_score worker pool, sized
+// to n. With top > 0 only each hunt's leaders are shown.
+void calculate_all_scores(int max_procs, int top) {
+    if (monitor_active && max_procs == 0) {
+        char cmd[MAX_CMD_LEN];
+        snprintf(cmd, sizeof(cmd), "calculate_all_scores --top %d", top);
+        run_monitor_command(cmd);
+        return;
+    }
+
+    ScoreJob *jobs;
+    ssize_t count = collect_score_jobs(&jobs);
+    if (count <= 0) {
+        return;
+    }
+
+    if (max_procs > 0) {
+        score_with_processes(jobs, count, max_procs, top);
+    } else {
+        score_with_threads(jobs, count, top);
+    }
+
+    for (ssize_t i = 0; i < count; i++) {
+        printf("Calculating scores for hunt: %s\n", jobs[i].hunt_id);
+        printf("Score results:\n");
+        if (jobs[i].report) {
+            fwrite(jobs[i].report, 1, jobs[i].report_len, stdout);
+        }
+        free(jobs[i].report);
+    }
+    free(jobs);
+}
+
+// Parses "[--procs <n>] [--top <k>]". Returns 0, or -1 on anything else.
+int parse_score_options(const char *args, int *max_procs, int *top) {
+    *max_procs = 0;
+    *top = 0;
+
+    char option[32];
+    int value;
+    int consumed;
+    while (sscanf(args, " %31s %d%n", option, &value, &consumed) == 2) {
+        if (strcmp(option, "--procs") == 0 && value > 0) {
+            *max_procs = value;
+        } else if (strcmp(option, "--top") == 0 && value > 0) {
+            *top = value;
+        } else {
+            return -1;
+        }
+        args += consumed;
+    }
+
+    return args[strspn(args, " ")] == '\0' ? 0 : -1;
 }
 
 int main() {
@@ -204,6 +617,10 @@ int main() {
     char cmd[MAX_CMD_LEN];
     char hunt_id[MAX_HUNT_ID_LEN];
     char treasure_id[MAX_TREASURE_ID_LEN];
+    char user[MAX_NAME_LEN];
+    int max_procs;
+    int top;
+    double number;
 
     setup_signal_handlers();
 
@@ -211,10 +628,13 @@ int main() {
     printf("Available commands:\n");
     printf("  start_monitor\n");
     printf("  list_hunts\n");
-    printf("  list_treasures <hunt_id>\n");
+    printf("  list_treasures <hunt_id> [hunt_id...]\n");
     printf("  view_treasure <hunt_id> <treasure_id>\n");
-    printf("  calculate_score <hunt_id>\n");
-    printf("  calculate_all_scores\n");
+    printf("  near_treasures <hunt_id> <latitude> <longitude> <radius_km>\n");
+    printf("  bbox_treasures <hunt_id> <min_lat> <min_lon> <max_lat> <max_lon>\n");
+    printf("  by_user <user>\n");
+    printf("  calculate_score <hunt_id> [--top <k>]\n");
+    printf("  calculate_all_scores [--procs <n>] [--top <k>]\n");
     printf("  stop_monitor\n");
     printf("  exit\n\n");
 
@@ -238,14 +658,23 @@ int main() {
             stop_monitor();
         } else if (strcmp(input, "list_hunts") == 0) {
             list_hunts();
-        } else if (sscanf(input, "list_treasures %s", hunt_id) == 1) {
-            list_treasures(hunt_id);
+        } else if (strncmp(input, "list_treasures ", 15) == 0) {
+            list_treasures(input + 15);
         } else if (sscanf(input, "view_treasure %s %s", hunt_id, treasure_id) == 2) {
             view_treasure(hunt_id, treasure_id);
+        } else if (sscanf(input, "near_treasures %s %*f %*f %lf", hunt_id, &number) == 2) {
+            query_treasures("near_treasures", input + 15);
+        } else if (sscanf(input, "bbox_treasures %s %*f %*f %*f %lf", hunt_id, &number) == 2) {
+            query_treasures("bbox_treasures", input + 15);
+        } else if (sscanf(input, "by_user %49s", user) == 1) {
+            by_user(user);
         } else if (sscanf(input, "calculate_score %s", hunt_id) == 1) {
-            calculate_score(hunt_id);
-        } else if (strcmp(input, "calculate_all_scores") == 0) {
-            calculate_all_scores();
+            int top = 0;
+            sscanf(input, "calculate_score %*s --top %d", &top);
+            calculate_score(hunt_id, top);
+        } else if (strncmp(input, "calculate_all_scores", 20) == 0 &&
+                   parse_score_options(input + 20, &max_procs, &top) == 0) {
+            calculate_all_scores(max_procs, top);
         } else {
             printf("Unknown command. Type 'help' for available commands.\n");
         }
@@ -256,6 +685,7 @@ int main() {
         kill(monitor_pid, SIGTERM);
         sleep(1);
     }
+    scorer_pool_shutdown(&scorers);
     
     printf("Goodbye!\n");
     return 0;
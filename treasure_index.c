@@ -0,0 +1,459 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "treasure.h"
+#include "treasure_index.h"
+#include "treasure_lock.h"
+
+#define INDEX_MAGIC "TIDX"
+#define INDEX_VERSION 4
+#define INDEX_MIN_CAPACITY 64
+#define INDEX_DELETED ((int64_t)-1)
+
+// On-disk header, followed by `capacity` slots
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t data_size;  // size of treasures.dat the index describes
+    uint64_t data_inode; // inode of treasures.dat, catches replaced files
+    uint32_t capacity;   // number of slots, always a power of two
+    uint32_t used;       // occupied or deleted slots; both lengthen probe chains
+    uint64_t records;    // records in treasures.dat, tombstones included
+    uint64_t dead;       // tombstoned records in treasures.dat
+    uint64_t duplicates; // live records whose ID an earlier live record holds
+} IndexHeader;
+
+// An empty slot is all zeroes; a deleted one has an empty id and offset -1
+typedef struct {
+    char id[MAX_ID_LEN];
+    int64_t offset;
+} IndexSlot;
+
+static void build_paths(const char *hunt_id, char *data_path, char *index_path) {
+    snprintf(data_path, MAX_PATH_LEN, "hunts/%s/treasures.dat", hunt_id);
+    snprintf(index_path, MAX_PATH_LEN, "hunts/%s/treasures.idx", hunt_id);
+}
+
+static uint32_t hash_id(const char *id) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < MAX_ID_LEN && id[i] != '\0'; i++) {
+        hash ^= (unsigned char)id[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static off_t slot_position(uint32_t slot) {
+    return sizeof(IndexHeader) + (off_t)slot * sizeof(IndexSlot);
+}
+
+// Inserts into an in-memory slot table, keeping the first record for duplicate
+// IDs. Returns 1 when a slot was taken, 0 for a duplicate.
+static int insert_slot(IndexSlot *slots, uint32_t capacity, const char *id, off_t offset) {
+    uint32_t mask = capacity - 1;
+    IndexSlot *free_slot = NULL;
+
+    for (uint32_t n = 0, i = hash_id(id) & mask; n < capacity; n++, i = (i + 1) & mask) {
+        if (slots[i].id[0] == '\0') {
+            if (!free_slot) {
+                free_slot = &slots[i];
+            }
+            if (slots[i].offset != INDEX_DELETED) {
+                break;
+            }
+        } else if (strncmp(slots[i].id, id, MAX_ID_LEN) == 0) {
+            return 0;
+        }
+    }
+
+    if (!free_slot) {
+        return 0;
+    }
+    memset(free_slot, 0, sizeof(IndexSlot));
+    strncpy(free_slot->id, id, MAX_ID_LEN - 1);
+    free_slot->offset = offset;
+    return 1;
+}
+
+// Opens the index and validates its header; does not check freshness
+static int open_index(const char *index_path, int flags, IndexHeader *header) {
+    int fd = open(index_path, flags);
+    if (fd == -1) {
+        return -1;
+    }
+
+    if (pread(fd, header, sizeof(IndexHeader), 0) != sizeof(IndexHeader) ||
+        memcmp(header->magic, INDEX_MAGIC, 4) != 0 ||
+        header->version != INDEX_VERSION ||
+        header->capacity == 0 || (header->capacity & (header->capacity - 1)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Probes the on-disk table. Returns 1 with *slot set to the match, 0 with *slot
+// set to the first reusable position, -1 on read errors.
+static int probe(int fd, const IndexHeader *header, const char *id, uint32_t *slot, int64_t *offset) {
+    uint32_t mask = header->capacity - 1;
+    uint32_t start = hash_id(id) & mask;
+    int have_free = 0;
+
+    for (uint32_t n = 0; n < header->capacity; n++) {
+        uint32_t i = (start + n) & mask;
+        IndexSlot entry;
+        if (pread(fd, &entry, sizeof(entry), slot_position(i)) != sizeof(entry)) {
+            return -1;
+        }
+
+        if (entry.id[0] == '\0') {
+            if (!have_free) {
+                *slot = i;
+            }
+            if (entry.offset != INDEX_DELETED) {
+                return 0;
+            }
+            have_free = 1;
+        } else if (strncmp(entry.id, id, MAX_ID_LEN) == 0) {
+            *slot = i;
+            *offset = entry.offset;
+            return 1;
+        }
+    }
+
+    return have_free ? 0 : -1;
+}
+
+int index_rebuild(const char *hunt_id) {
+    char data_path[MAX_PATH_LEN];
+    char index_path[MAX_PATH_LEN];
+    build_paths(hunt_id, data_path, index_path);
+
+    struct stat st;
+    TreasureMap map;
+    if (stat(data_path, &st) == -1 || treasure_map_open(hunt_id, &map) == -1) {
+        return -1;
+    }
+
+    uint32_t capacity = INDEX_MIN_CAPACITY;
+    while (capacity < map.count * 2) {
+        capacity <<= 1;
+    }
+
+    IndexSlot *slots = calloc(capacity, sizeof(IndexSlot));
+    if (!slots) {
+        treasure_map_close(&map);
+        return -1;
+    }
+
+    uint32_t used = 0;
+    uint64_t records = 0;
+    uint64_t dead = 0;
+    uint64_t duplicates = 0;
+    const Treasure *treasure;
+    off_t offset;
+    while ((treasure = treasure_map_next(&map, &offset)) != NULL) {
+        records++;
+        if (!treasure_is_live(treasure)) {
+            dead++;
+            continue;
+        }
+        if (insert_slot(slots, capacity, treasure->id, offset)) {
+            used++;
+        } else {
+            duplicates++;
+        }
+    }
+
+    treasure_map_close(&map);
+
+    IndexHeader header = {0};
+    memcpy(header.magic, INDEX_MAGIC, 4);
+    header.version = INDEX_VERSION;
+    header.data_size = st.st_size;
+    header.data_inode = st.st_ino;
+    header.capacity = capacity;
+    header.used = used;
+    header.records = records;
+    header.dead = dead;
+    header.duplicates = duplicates;
+
+    // Write to a temporary file and rename so readers never see a partial index
+    char temp_path[MAX_PATH_LEN];
+    int temp_fd = temp_file_create(index_path, temp_path);
+    if (temp_fd == -1) {
+        free(slots);
+        return -1;
+    }
+
+    size_t slots_size = (size_t)capacity * sizeof(IndexSlot);
+    int ok = write(temp_fd, &header, sizeof(header)) == sizeof(header) &&
+             write(temp_fd, slots, slots_size) == (ssize_t)slots_size;
+    close(temp_fd);
+    free(slots);
+
+    if (!ok || rename(temp_path, index_path) == -1) {
+        remove(temp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int index_lookup(const char *hunt_id, const char *treasure_id, off_t *offset) {
+    char data_path[MAX_PATH_LEN];
+    char index_path[MAX_PATH_LEN];
+    build_paths(hunt_id, data_path, index_path);
+
+    struct stat st;
+    if (stat(data_path, &st) == -1) {
+        return -1;
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        IndexHeader header;
+        int fd = open_index(index_path, O_RDONLY, &header);
+        if (fd != -1 && (header.data_size != (uint64_t)st.st_size || header.data_inode != (uint64_t)st.st_ino)) {
+            close(fd);
+            fd = -1;
+        }
+
+        if (fd == -1) {
+            // Missing or stale: rebuild once, then give up
+            if (attempt == 0 && index_rebuild(hunt_id) == 0) {
+                continue;
+            }
+            return -1;
+        }
+
+        uint32_t slot;
+        int64_t found_offset;
+        int result = probe(fd, &header, treasure_id, &slot, &found_offset);
+        close(fd);
+
+        if (result == 1) {
+            *offset = found_offset;
+        }
+        return result;
+    }
+
+    return -1;
+}
+
+// Opens the index for appending `count` records at offset. Returns -1 when the
+// index does not describe exactly the file as it was before the append, or
+// has no room to stay at most half full; the caller then rebuilds instead.
+static int open_for_append(const char *hunt_id, off_t offset, size_t count, IndexHeader *header) {
+    char data_path[MAX_PATH_LEN];
+    char index_path[MAX_PATH_LEN];
+    build_paths(hunt_id, data_path, index_path);
+
+    struct stat st;
+    if (stat(data_path, &st) == -1) {
+        return -1;
+    }
+
+    int fd = open_index(index_path, O_RDWR, header);
+    if (fd != -1 && (header->data_size != (uint64_t)offset || header->data_inode != (uint64_t)st.st_ino ||
+                     (header->used + count) * 2 > header->capacity)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int index_add(const char *hunt_id, const char *treasure_id, off_t offset, off_t data_size) {
+    IndexHeader header;
+    int fd = open_for_append(hunt_id, offset, 1, &header);
+    if (fd == -1) {
+        return index_rebuild(hunt_id);
+    }
+
+    uint32_t slot;
+    int64_t existing;
+    int result = probe(fd, &header, treasure_id, &slot, &existing);
+    if (result == -1) {
+        close(fd);
+        return index_rebuild(hunt_id);
+    }
+
+    if (result == 0) {
+        IndexSlot entry = {0};
+        strncpy(entry.id, treasure_id, MAX_ID_LEN - 1);
+        entry.offset = offset;
+        if (pwrite(fd, &entry, sizeof(entry), slot_position(slot)) != sizeof(entry)) {
+            close(fd);
+            return index_rebuild(hunt_id);
+        }
+        header.used++;
+    } else {
+        header.duplicates++;
+    }
+
+    header.records++;
+    header.data_size = data_size;
+    int ok = pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+    close(fd);
+
+    return ok ? 0 : index_rebuild(hunt_id);
+}
+
+int index_add_batch(const char *hunt_id, const Treasure *records, const off_t *offsets, size_t count, off_t data_size) {
+    if (count == 0) {
+        return 0;
+    }
+
+    IndexHeader header;
+    int fd = open_for_append(hunt_id, offsets[0], count, &header);
+    if (fd == -1) {
+        return index_rebuild(hunt_id);
+    }
+
+    // Update the slot table in place through a shared mapping
+    size_t length = slot_position(header.capacity);
+    void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return index_rebuild(hunt_id);
+    }
+
+    IndexSlot *slots = (IndexSlot *)((char *)base + sizeof(IndexHeader));
+    for (size_t i = 0; i < count; i++) {
+        if (insert_slot(slots, header.capacity, records[i].id, offsets[i])) {
+            header.used++;
+        } else {
+            header.duplicates++;
+        }
+    }
+    munmap(base, length);
+
+    header.records += count;
+    header.data_size = data_size;
+    int ok = pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+    close(fd);
+
+    return ok ? 0 : index_rebuild(hunt_id);
+}
+
+int index_remove(const char *hunt_id, const char *treasure_id, size_t removed) {
+    char data_path[MAX_PATH_LEN];
+    char index_path[MAX_PATH_LEN];
+    build_paths(hunt_id, data_path, index_path);
+
+    struct stat st;
+    if (stat(data_path, &st) == -1) {
+        return -1;
+    }
+
+    // Tombstoning rewrites a byte in place, so size and inode are unchanged
+    IndexHeader header;
+    int fd = open_index(index_path, O_RDWR, &header);
+    if (fd == -1 || header.data_size != (uint64_t)st.st_size || header.data_inode != (uint64_t)st.st_ino) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return index_rebuild(hunt_id);
+    }
+
+    // Only a record the index held becomes a tombstone it counts
+    uint32_t slot;
+    int64_t offset;
+    int ok = 1;
+    if (probe(fd, &header, treasure_id, &slot, &offset) == 1) {
+        IndexSlot entry = {0};
+        entry.offset = INDEX_DELETED;
+        if (pwrite(fd, &entry, sizeof(entry), slot_position(slot)) != sizeof(entry)) {
+            close(fd);
+            return index_rebuild(hunt_id);
+        }
+        header.dead += removed;
+        header.duplicates -= removed - 1 < header.duplicates ? removed - 1 : header.duplicates;
+        ok = pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+    }
+    close(fd);
+
+    return ok ? 0 : index_rebuild(hunt_id);
+}
+
+// Reads the header of an index that matches treasures.dat, rebuilding a
+// missing or stale one first. Returns 0 or -1.
+static int fresh_header(const char *hunt_id, IndexHeader *header) {
+    char data_path[MAX_PATH_LEN];
+    char index_path[MAX_PATH_LEN];
+    build_paths(hunt_id, data_path, index_path);
+
+    struct stat st;
+    if (stat(data_path, &st) == -1) {
+        return -1;
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int fd = open_index(index_path, O_RDONLY, header);
+        if (fd != -1) {
+            close(fd);
+            if (header->data_size == (uint64_t)st.st_size && header->data_inode == (uint64_t)st.st_ino) {
+                return 0;
+            }
+        }
+        if (attempt > 0 || index_rebuild(hunt_id) == -1) {
+            break;
+        }
+    }
+
+    return -1;
+}
+
+int index_counts(const char *hunt_id, size_t *records, size_t *dead) {
+    IndexHeader header;
+    if (fresh_header(hunt_id, &header) == -1) {
+        return -1;
+    }
+    *records = header.records;
+    *dead = header.dead;
+    return 0;
+}
+
+int index_has_duplicates(const char *hunt_id) {
+    IndexHeader header;
+    if (fresh_header(hunt_id, &header) == -1) {
+        return -1;
+    }
+    return header.duplicates > 0;
+}
+
+const Treasure *index_find(const char *hunt_id, TreasureMap *map, const char *treasure_id, off_t *offset) {
+    off_t found;
+    int result = index_lookup(hunt_id, treasure_id, &found);
+    if (result == 0) {
+        return NULL;
+    }
+
+    const Treasure *treasure;
+    if (result == 1 && (treasure = treasure_map_at(map, found)) != NULL &&
+        strncmp(treasure->id, treasure_id, MAX_ID_LEN) == 0) {
+        if (offset) {
+            *offset = found;
+        }
+        return treasure;
+    }
+
+    // Index unavailable or pointing at the wrong record: scan the mapping
+    map->position = treasure_file_data_start(map->format);
+    while ((treasure = treasure_map_next(map, &found)) != NULL) {
+        if (treasure_is_live(treasure) && strcmp(treasure->id, treasure_id) == 0) {
+            if (offset) {
+                *offset = found;
+            }
+            return treasure;
+        }
+    }
+
+    return NULL;
+}
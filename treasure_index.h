@@ -0,0 +1,43 @@
+#ifndef TREASURE_INDEX_H
+#define TREASURE_INDEX_H
+
+#include <sys/types.h>
+#include "treasure.h"
+#include "treasure_map.h"
+
+// Sidecar hash index (hunts/<id>/treasures.idx) mapping a treasure ID to the
+// byte offset of its record in treasures.dat. The index remembers the size and
+// inode of the data file it describes and is rebuilt on demand when they no
+// longer match, so a stale index is never trusted.
+
+// Returns 1 and sets *offset when the ID is found, 0 when it is not, -1 on error.
+int index_lookup(const char *hunt_id, const char *treasure_id, off_t *offset);
+
+// Records a treasure appended at offset; data_size is the file size after the append.
+int index_add(const char *hunt_id, const char *treasure_id, off_t offset, off_t data_size);
+
+// Records `count` treasures appended together, each at its offsets[i]
+int index_add_batch(const char *hunt_id, const Treasure *records, const off_t *offsets, size_t count, off_t data_size);
+
+// Drops treasure_id from the index after the `removed` live records holding
+// it were tombstoned in place
+int index_remove(const char *hunt_id, const char *treasure_id, size_t removed);
+
+// Reports how many records treasures.dat holds and how many are tombstones
+int index_counts(const char *hunt_id, size_t *records, size_t *dead);
+
+// IDs need not be unique and the index keeps only the first live record for
+// each. Returns 1 when some live record shares its ID with an earlier one, 0
+// when none does, -1 on error.
+int index_has_duplicates(const char *hunt_id);
+
+// Finds the record for treasure_id in the mapped data file: one index probe,
+// falling back to a linear scan if the index is unusable. Returns the record
+// (valid until the map is next used) and its offset, or NULL when the ID is
+// not present.
+const Treasure *index_find(const char *hunt_id, TreasureMap *map, const char *treasure_id, off_t *offset);
+
+// Rescans treasures.dat and rewrites the index from scratch.
+int index_rebuild(const char *hunt_id);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <errno.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "treasure.h"
+#include "treasure_lock.h"
+
+int hunt_lock(const char *hunt_id, int operation) {
+    char path[MAX_PATH_LEN];
+    snprintf(path, MAX_PATH_LEN, "hunts/%s/.lock", hunt_id);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd == -1) {
+        return -1;
+    }
+    while (flock(fd, operation) == -1) {
+        if (errno != EINTR) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    // The hunt may have been removed while we waited
+    struct stat locked;
+    struct stat current;
+    if (fstat(fd, &locked) == -1 || stat(path, &current) == -1 || locked.st_ino != current.st_ino) {
+        close(fd);
+        errno = ENOENT;
+        return -1;
+    }
+    return fd;
+}
+
+void hunt_unlock(int fd) {
+    if (fd != -1) {
+        close(fd); // closing drops the flock
+    }
+}
+
+int temp_file_create(const char *path, char *temp_path) {
+    // The process ID and a counter keep names unique across processes and
+    // the monitor's threads; O_EXCL catches leftovers from a crashed run
+    static unsigned int counter = 0;
+    while (1) {
+        unsigned int n = __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+        snprintf(temp_path, MAX_PATH_LEN, "%s.%d.%u.tmp", path, (int)getpid(), n);
+        int fd = open(temp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (fd != -1 || errno != EEXIST) {
+            return fd;
+        }
+    }
+}
+
+int durable_replace(const char *temp_path, const char *path) {
+    int fd = open(temp_path, O_RDONLY);
+    if (fd == -1 || fsync(fd) == -1) {
+        if (fd != -1) {
+            close(fd);
+        }
+        remove(temp_path);
+        return -1;
+    }
+    close(fd);
+
+    if (rename(temp_path, path) == -1) {
+        remove(temp_path);
+        return -1;
+    }
+
+    // The rename itself lives in the directory
+    char dir_path[MAX_PATH_LEN];
+    snprintf(dir_path, MAX_PATH_LEN, "%s", path);
+    int dir_fd = open(dirname(dir_path), O_RDONLY | O_DIRECTORY);
+    if (dir_fd == -1) {
+        return -1;
+    }
+    int result = fsync(dir_fd);
+    close(dir_fd);
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#ifndef TREASURE_LOCK_H
+#define TREASURE_LOCK_H
+
+#include <sys/file.h>
+
+// Coordination between processes working on the same hunt.
+//
+// Every treasure_manager command locks hunts/<id>/.lock with flock for its
+// whole run: writers (add, remove, compact, build-columns) exclusively, so
+// an append, its index/column/geo updates and its log entry happen as one
+// step; readers shared, so they never see a writer's sidecar updates half
+// done. Readers that mmap treasures.dat directly (the monitor and
+// calculate_score) need no lock: appends only grow the file, tombstones are
+// single bytes and compaction replaces the file by rename.
+//
+// The lock belongs to the open file description, so a child forked while it
+// is held (background compaction) keeps holding it after the parent exits.
+
+// Locks the hunt with LOCK_SH or LOCK_EX, waiting for conflicting holders.
+// Returns the lock's fd, or -1 when the hunt directory does not exist.
+int hunt_lock(const char *hunt_id, int operation);
+
+// Releases a lock from hunt_lock; -1 is ignored
+void hunt_unlock(int fd);
+
+// Creates a uniquely named temporary file next to path, so concurrent
+// rebuilds of the same file never write to each other's temporary. Stores
+// its name in temp_path (MAX_PATH_LEN bytes) and returns an fd open for
+// writing, or -1.
+int temp_file_create(const char *path, char *temp_path);
+
+// Replaces path with temp_path so that after a crash either the old or the
+// new contents are found complete: the new file is flushed before the rename
+// and the directory after it. Returns 0, or -1 (temp_path is then removed).
+int durable_replace(const char *temp_path, const char *path);
+
+#endif
\ No newline at end of file
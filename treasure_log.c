@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "treasure.h"
+#include "treasure_log.h"
+
+#define RING_SIZE (64 * 1024)
+#define GROUP_BYTES (16 * 1024)   // wake the writer once this much is pending
+#define GROUP_WINDOW_MS 5         // or once the oldest entry has waited this long
+#define MAX_ENTRY_LEN 1024
+#define DEFAULT_FSYNC_MS 1000
+
+typedef enum {
+    FSYNC_NONE,
+    FSYNC_INTERVAL,
+    FSYNC_ALWAYS
+} FsyncPolicy;
+
+struct OpLog {
+    int fd;
+    FsyncPolicy policy;
+    long fsync_ms;
+    struct timespec last_sync;
+
+    // head and tail only grow; their difference is the pending byte count
+    char ring[RING_SIZE];
+    size_t head;
+    size_t tail;
+    int stopping;
+    int flushing;
+
+    pthread_mutex_t lock;
+    pthread_cond_t pending;  // signalled when entries arrive or on close
+    pthread_cond_t drained;  // signalled when the writer frees space
+    pthread_t writer;
+};
+
+static long elapsed_ms(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+static void sync_if_due(OpLog *log, int closing) {
+    if (log->policy == FSYNC_NONE) {
+        return;
+    }
+    if (log->policy == FSYNC_INTERVAL && !closing && elapsed_ms(&log->last_sync) < log->fsync_ms) {
+        return;
+    }
+    fdatasync(log->fd);
+    clock_gettime(CLOCK_MONOTONIC, &log->last_sync);
+}
+
+// Writes one group: everything pending, with a second iovec if it wraps
+static void write_group(OpLog *log, size_t tail, size_t head) {
+    size_t start = tail % RING_SIZE;
+    size_t length = head - tail;
+    size_t first = length < RING_SIZE - start ? length : RING_SIZE - start;
+
+    struct iovec iov[2];
+    int iovcnt = 0;
+    iov[iovcnt++] = (struct iovec){ log->ring + start, first };
+    if (length > first) {
+        iov[iovcnt++] = (struct iovec){ log->ring, length - first };
+    }
+
+    struct iovec *cur = iov;
+    while (iovcnt > 0) {
+        ssize_t bytes = writev(log->fd, cur, iovcnt);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to write log");
+            return;
+        }
+        while (iovcnt > 0 && (size_t)bytes >= cur->iov_len) {
+            bytes -= cur->iov_len;
+            cur++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            cur->iov_base = (char *)cur->iov_base + bytes;
+            cur->iov_len -= bytes;
+        }
+    }
+}
+
+static void *writer_main(void *arg) {
+    OpLog *log = arg;
+
+    pthread_mutex_lock(&log->lock);
+    while (1) {
+        // Group commit: let entries accumulate for a short window
+        while (!log->stopping) {
+            if (log->head == log->tail) {
+                pthread_cond_wait(&log->pending, &log->lock);
+                continue;
+            }
+            if (log->flushing || log->head - log->tail >= GROUP_BYTES) {
+                break;
+            }
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += GROUP_WINDOW_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            if (pthread_cond_timedwait(&log->pending, &log->lock, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+
+        size_t tail = log->tail;
+        size_t head = log->head;
+        if (tail == head && log->stopping) {
+            break;
+        }
+
+        // The ring region [tail, head) is ours until tail advances
+        pthread_mutex_unlock(&log->lock);
+        if (head > tail) {
+            write_group(log, tail, head);
+            sync_if_due(log, 0);
+        }
+        pthread_mutex_lock(&log->lock);
+
+        log->tail = head;
+        pthread_cond_broadcast(&log->drained);
+    }
+    pthread_mutex_unlock(&log->lock);
+
+    return NULL;
+}
+
+OpLog *oplog_open(const char *hunt_id, int refresh_link) {
+    char log_path[MAX_PATH_LEN];
+    snprintf(log_path, MAX_PATH_LEN, "hunts/%s/logged_hunt", hunt_id);
+
+    OpLog *log = calloc(1, sizeof(OpLog));
+    if (!log) {
+        return NULL;
+    }
+
+    log->fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (log->fd == -1) {
+        perror("Failed to open log file");
+        free(log);
+        return NULL;
+    }
+
+    const char *policy = getenv("TREASURE_LOG_FSYNC");
+    if (policy && strcmp(policy, "always") == 0) {
+        log->policy = FSYNC_ALWAYS;
+    } else if (policy && strcmp(policy, "interval") == 0) {
+        log->policy = FSYNC_INTERVAL;
+    }
+    const char *interval = getenv("TREASURE_LOG_FSYNC_MS");
+    log->fsync_ms = interval ? atol(interval) : DEFAULT_FSYNC_MS;
+    clock_gettime(CLOCK_MONOTONIC, &log->last_sync);
+
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->pending, NULL);
+    pthread_cond_init(&log->drained, NULL);
+    if (pthread_create(&log->writer, NULL, writer_main, log) != 0) {
+        perror("Failed to start log writer");
+        close(log->fd);
+        free(log);
+        return NULL;
+    }
+
+    // Only a new hunt needs its link; existing hunts keep theirs
+    if (refresh_link) {
+        char link_path[MAX_PATH_LEN];
+        snprintf(link_path, MAX_PATH_LEN, "logged_hunt-%s", hunt_id);
+        remove(link_path); // Remove existing link if any
+        if (link(log_path, link_path) != 0) {
+            perror("Failed to create link");
+        }
+    }
+
+    return log;
+}
+
+void oplog_append(OpLog *log, const char *operation) {
+    char time_str[32];
+    time_t now = time(NULL);
+    ctime_r(&now, time_str);
+    time_str[strcspn(time_str, "\n")] = '\0';
+
+    char entry[MAX_ENTRY_LEN];
+    int length = snprintf(entry, sizeof(entry), "[%s] %s\n", time_str, operation);
+    if (length < 0) {
+        return;
+    }
+    if (length >= (int)sizeof(entry)) {
+        length = sizeof(entry) - 1;
+        entry[length - 1] = '\n';
+    }
+
+    pthread_mutex_lock(&log->lock);
+    while (RING_SIZE - (log->head - log->tail) < (size_t)length) {
+        pthread_cond_wait(&log->drained, &log->lock);
+    }
+
+    size_t start = log->head % RING_SIZE;
+    size_t first = (size_t)length < RING_SIZE - start ? (size_t)length : RING_SIZE - start;
+    memcpy(log->ring + start, entry, first);
+    memcpy(log->ring, entry + first, length - first);
+    log->head += length;
+
+    pthread_cond_signal(&log->pending);
+    pthread_mutex_unlock(&log->lock);
+}
+
+void oplog_flush(OpLog *log) {
+    pthread_mutex_lock(&log->lock);
+    size_t target = log->head;
+    log->flushing = 1;
+    pthread_cond_signal(&log->pending);
+    while (log->tail < target) {
+        pthread_cond_wait(&log->drained, &log->lock);
+    }
+    log->flushing = 0;
+    pthread_mutex_unlock(&log->lock);
+}
+
+void oplog_close(OpLog *log) {
+    pthread_mutex_lock(&log->lock);
+    log->stopping = 1;
+    pthread_cond_signal(&log->pending);
+    pthread_mutex_unlock(&log->lock);
+
+    pthread_join(log->writer, NULL);
+    sync_if_due(log, 1);
+
+    close(log->fd);
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->pending);
+    pthread_cond_destroy(&log->drained);
+    free(log);
+}
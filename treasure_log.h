@@ -0,0 +1,29 @@
+#ifndef TREASURE_LOG_H
+#define TREASURE_LOG_H
+
+// Operation log for a hunt (hunts/<id>/logged_hunt). The file stays open for
+// the life of the logger; entries go into a ring buffer that a background
+// writer drains in groups, one write per group. Durability is chosen with the
+// TREASURE_LOG_FSYNC environment variable:
+//
+//   none      never fsync (default, same as the original logger)
+//   interval  fdatasync at most every TREASURE_LOG_FSYNC_MS ms (default 1000)
+//   always    fdatasync after every group written
+//
+// oplog_close always flushes, and syncs unless the policy is none.
+
+typedef struct OpLog OpLog;
+
+// Opens the hunt's log. With refresh_link set (the hunt was just created),
+// also points the logged_hunt-<id> hard link at it. Returns NULL on failure.
+OpLog *oplog_open(const char *hunt_id, int refresh_link);
+
+// Queues one "[timestamp] operation" entry; blocks only while the ring is full.
+void oplog_append(OpLog *log, const char *operation);
+
+// Waits until every queued entry has been written.
+void oplog_flush(OpLog *log);
+
+void oplog_close(OpLog *log);
+
+#endif
\ No newline at end of file
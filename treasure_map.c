@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "treasure_map.h"
+
+int treasure_map_open(const char *hunt_id, TreasureMap *map) {
+    memset(map, 0, sizeof(TreasureMap));
+
+    char path[MAX_PATH_LEN];
+    snprintf(path, MAX_PATH_LEN, "hunts/%s/treasures.dat", hunt_id);
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    // mmap rejects zero-length mappings; an empty hunt is simply no records
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the file referenced
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+    madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+    map->base = base;
+    map->length = st.st_size;
+    map->format = treasure_file_detect(base, st.st_size);
+
+    if (map->format == TREASURE_FORMAT_COMPACT) {
+        const TreasureFileHeader *header = base;
+        if (header->version != TREASURE_FILE_VERSION || header->header_size > st.st_size) {
+            treasure_map_close(map);
+            errno = ENOTSUP;
+            return -1;
+        }
+        map->count = header->record_count;
+        map->position = header->header_size;
+    } else {
+        map->count = st.st_size / sizeof(Treasure); // a torn trailing record is ignored
+    }
+    return 0;
+}
+
+const Treasure *treasure_map_at(TreasureMap *map, off_t offset) {
+    if (offset < (off_t)treasure_file_data_start(map->format) || (size_t)offset >= map->length) {
+        return NULL;
+    }
+
+    if (map->format == TREASURE_FORMAT_LEGACY) {
+        if ((size_t)offset % sizeof(Treasure) != 0 || map->length - offset < sizeof(Treasure)) {
+            return NULL;
+        }
+        return (const Treasure *)(map->base + offset);
+    }
+
+    if (treasure_file_decode(map->format, map->base + offset, map->length - offset, &map->scratch) == 0) {
+        return NULL;
+    }
+    return &map->scratch;
+}
+
+const Treasure *treasure_map_next(TreasureMap *map, off_t *offset) {
+    if (!map->base || (size_t)map->position >= map->length) {
+        return NULL;
+    }
+
+    size_t available = map->length - map->position;
+    const char *data = map->base + map->position;
+
+    if (map->format == TREASURE_FORMAT_LEGACY) {
+        if (available < sizeof(Treasure)) {
+            return NULL;
+        }
+        if (offset) {
+            *offset = map->position;
+        }
+        map->position += sizeof(Treasure);
+        return (const Treasure *)data;
+    }
+
+    size_t length = treasure_file_decode(map->format, data, available, &map->scratch);
+    if (length == 0) {
+        return NULL; // torn or corrupt tail
+    }
+    if (offset) {
+        *offset = map->position;
+    }
+    map->position += length;
+    return &map->scratch;
+}
+
+void treasure_map_close(TreasureMap *map) {
+    if (map->base) {
+        munmap((void *)map->base, map->length);
+    }
+    memset(map, 0, sizeof(TreasureMap));
+}
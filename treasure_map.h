@@ -0,0 +1,33 @@
+#ifndef TREASURE_MAP_H
+#define TREASURE_MAP_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "treasure.h"
+#include "treasure_file.h"
+
+// Read-only memory mapping of hunts/<id>/treasures.dat in either on-disk
+// format. Scans walk the mapping without a syscall per record: legacy records
+// are returned in place, compact ones are decoded into `scratch`, so a
+// returned pointer is only valid until the next call.
+typedef struct {
+    TreasureFormat format;
+    const char *base;
+    size_t length;
+    size_t count;     // records in the file, tombstones included
+    off_t position;   // cursor of treasure_map_next
+    Treasure scratch;
+} TreasureMap;
+
+// Returns 0 on success, -1 if the file cannot be opened or mapped (errno is set).
+int treasure_map_open(const char *hunt_id, TreasureMap *map);
+
+// Returns the next record in file order and its offset, or NULL at the end.
+const Treasure *treasure_map_next(TreasureMap *map, off_t *offset);
+
+// Returns the record at offset, or NULL if no record can be decoded there.
+const Treasure *treasure_map_at(TreasureMap *map, off_t offset);
+
+void treasure_map_close(TreasureMap *map);
+
+#endif
\ No newline at end of file
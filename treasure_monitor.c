@@ -1,193 +1,666 @@
 #include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 #include <dirent.h>
 #include "treasure.h"
+#include "treasure_protocol.h"
+#include "treasure_index.h"
+#include "treasure_map.h"
+#include "treasure_geo.h"
+#include "treasure_cache.h"
+#include "treasure_score.h"
+#include "treasure_tally.h"
+#include "treasure_catalog.h"
+#include "treasure_users.h"
+#include "treasure_ring.h"
+
+#define MAX_EVENTS 64
+#define MIN_WORKERS 2
+#define MAX_WORKERS 64
+#define READ_CHUNK 65536
+#define SEND_TIMEOUT_SEC 30 // a client that stops reading releases its workers
+#define MAX_PASSED_FDS 3
+
+// One client connection. The event loop reads requests from it and queues
+// them; workers answer them concurrently, taking turns on write_lock per frame.
+typedef struct Connection {
+    int fd;
+    int refs; // the event loop plus queued and running commands
+    FrameLock write_lock;
+    Ring *ring; // replies go here instead of fd once the client attached one
+    int passed_fds[MAX_PASSED_FDS]; // received with SCM_RIGHTS, awaiting attach_ring
+    int passed_count;
+    char *input; // received bytes not yet parsed into frames
+    size_t input_length;
+    size_t input_capacity;
+    struct Connection *prev; // registered connections, event loop only
+    struct Connection *next;
+} Connection;
+
+typedef struct Job {
+    Connection *conn;
+    uint32_t request_id;
+    char *cmd;
+    struct Job *next;
+} Job;
+
+typedef struct {
+    Job *head;
+    Job *tail;
+    int stopping;
+    pthread_mutex_t lock; // also guards Connection.refs
+    pthread_cond_t ready;
+} JobQueue;
+
+JobQueue job_queue = { NULL, NULL, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+Connection *connections = NULL;
+HuntCache hunt_cache;
+TallyState score_tally;
+
+// SIGTERM and SIGINT arrive through a signalfd in the event loop, so they are
+// blocked in every thread
+int setup_signal_handlers() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    // A vanished client must not kill the monitor
+    signal(SIGPIPE, SIG_IGN);
+
+    return signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+}
 
-#define COMMAND_FILE "/tmp/treasure_monitor_cmd"
-#define OUTPUT_PIPE "/tmp/treasure_monitor_output"
+int compare_entries(const void *a, const void *b) {
+    return strcmp(((const CatalogEntry *)a)->hunt_id, ((const CatalogEntry *)b)->hunt_id);
+}
 
-volatile sig_atomic_t command_received = 0;
-int output_fd = -1;
+void list_hunts(ResponseWriter *out) {
+    // One read of the catalog, however many hunts there are
+    CatalogEntry *entries;
+    size_t count;
+    if (catalog_list(&entries, &count) == -1) {
+        response_printf(out, "Error: Could not open hunts directory\n");
+        return;
+    }
 
-void handle_sigusr1(int sig) {
-    command_received = 1;
+    qsort(entries, count, sizeof(CatalogEntry), compare_entries);
+    response_printf(out, "=== List of Hunts ===\n");
+    for (size_t i = 0; i < count; i++) {
+        response_printf(out, "%s: %llu treasures\n", entries[i].hunt_id,
+                        (unsigned long long)entries[i].summary.live);
+    }
+    free(entries);
 }
 
-void setup_signal_handlers() {
-    struct sigaction sa;
-    sa.sa_handler = handle_sigusr1;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART;
-    sigaction(SIGUSR1, &sa, NULL);
+void send_treasure_row(ResponseWriter *out, const Treasure *treasure) {
+    response_printf(out, "%s\t%s\t%.6f\t%.6f\t%d\n",
+           treasure->id, treasure->user,
+           treasure->latitude, treasure->longitude,
+           treasure->value);
 }
 
-void send_output(const char *message) {
-    if (output_fd == -1) {
-        output_fd = open(OUTPUT_PIPE, O_WRONLY);
-        if (output_fd == -1) {
-            perror("open output pipe");
-            return;
+void list_treasures(ResponseWriter *out, const char *hunt_id) {
+    const char *heading = "=== Treasures in Hunt ===\n"
+                          "ID\tUser\tLatitude\tLongitude\tValue\n"
+                          "--------------------------------------------------\n";
+
+    // Hot hunts are served from memory
+    const CachedHunt *hunt = hunt_cache_get(&hunt_cache, hunt_id);
+    if (hunt) {
+        response_printf(out, "%s", heading);
+        for (size_t i = 0; i < hunt->count; i++) {
+            send_treasure_row(out, &hunt->records[i]);
         }
+        hunt_cache_release(&hunt_cache, hunt);
+        return;
+    }
+
+    TreasureMap map;
+    if (treasure_map_open(hunt_id, &map) == -1) {
+        response_printf(out, "Error: Could not open treasures file\n");
+        return;
     }
-    write(output_fd, message, strlen(message));
+
+    response_printf(out, "%s", heading);
+
+    const Treasure *treasure;
+    while ((treasure = treasure_map_next(&map, NULL)) != NULL) {
+        if (treasure_is_live(treasure)) {
+            send_treasure_row(out, treasure);
+        }
+    }
+
+    treasure_map_close(&map);
 }
 
-void list_hunts() {
-    DIR *dir;
-    struct dirent *entry;
-    char output[1024] = {0};
+void view_treasure(ResponseWriter *out, const char *hunt_id, const char *treasure_id) {
+    const CachedHunt *hunt = hunt_cache_get(&hunt_cache, hunt_id);
+    TreasureMap map = {0};
+    if (!hunt && treasure_map_open(hunt_id, &map) == -1) {
+        response_printf(out, "Error: Could not open treasures file\n");
+        return;
+    }
 
-    dir = opendir("hunts");
-    if (dir == NULL) {
-        send_output("Error: Could not open hunts directory\n");
+    const Treasure *treasure = hunt ? cached_hunt_find(hunt, treasure_id) : index_find(hunt_id, &map, treasure_id, NULL);
+
+    if (treasure) {
+        response_printf(out,
+               "=== Treasure Details ===\n"
+               "Hunt ID: %s\n"
+               "Treasure ID: %s\n"
+               "User: %s\n"
+               "Coordinates: %.6f, %.6f\n"
+               "Clue: %s\n"
+               "Value: %d\n",
+               hunt_id, treasure->id, treasure->user,
+               treasure->latitude, treasure->longitude,
+               treasure->clue, treasure->value);
+    } else {
+        response_printf(out, "Treasure with ID %s not found in hunt %s\n", treasure_id, hunt_id);
+    }
+
+    if (hunt) {
+        hunt_cache_release(&hunt_cache, hunt);
+    }
+    treasure_map_close(&map);
+}
+
+// Streams the live treasures behind spatial query matches
+void send_matches(ResponseWriter *out, const char *hunt_id, GeoMatch *matches, size_t count, int show_distance) {
+    TreasureMap map;
+    if (treasure_map_open(hunt_id, &map) == -1) {
+        response_printf(out, "Error: Could not open treasures file\n");
         return;
     }
 
-    strcat(output, "=== List of Hunts ===\n");
+    response_printf(out, "ID\tUser\tLatitude\tLongitude\tValue%s\n"
+                         "--------------------------------------------------\n",
+                    show_distance ? "\tDistance (km)" : "");
 
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+    size_t shown = 0;
+    for (size_t i = 0; i < count; i++) {
+        const Treasure *treasure = treasure_map_at(&map, matches[i].offset);
+        if (!treasure || !treasure_is_live(treasure)) {
             continue;
         }
-
-        char path[256];
-        snprintf(path, sizeof(path), "hunts/%s/treasures.dat", entry->d_name);
-
-        struct stat st;
-        if (stat(path, &st) == 0) {
-            int count = st.st_size / sizeof(Treasure);
-            char line[256];
-            snprintf(line, sizeof(line), "%s: %d treasures\n", entry->d_name, count);
-            strcat(output, line);
+        response_printf(out, "%s\t%s\t%.6f\t%.6f\t%d",
+               treasure->id, treasure->user,
+               treasure->latitude, treasure->longitude,
+               treasure->value);
+        if (show_distance) {
+            response_printf(out, "\t%.3f", matches[i].distance);
         }
+        response_printf(out, "\n");
+        shown++;
     }
+    response_printf(out, "%zu treasure(s) found.\n", shown);
 
-    closedir(dir);
-    send_output(output);
+    treasure_map_close(&map);
 }
 
-void list_treasures(const char *hunt_id) {
-    char path[256];
-    snprintf(path, sizeof(path), "hunts/%s/treasures.dat", hunt_id);
-
-    int fd = open(path, O_RDONLY);
-    if (fd == -1) {
-        send_output("Error: Could not open treasures file\n");
+void near_treasures(ResponseWriter *out, const char *hunt_id, double lat, double lon, double radius) {
+    GeoMatch *matches;
+    size_t count;
+    if (radius < 0 || geo_query_near(hunt_id, lat, lon, radius, &matches, &count) == -1) {
+        response_printf(out, "Error: Could not query hunt %s\n", hunt_id);
         return;
     }
 
-    char output[2048] = {0};
-    strcat(output, "=== Treasures in Hunt ===\n");
-    strcat(output, "ID\tUser\tLatitude\tLongitude\tValue\n");
-    strcat(output, "--------------------------------------------------\n");
+    response_printf(out, "=== Treasures within %.3f km of %.6f, %.6f ===\n", radius, lat, lon);
+    send_matches(out, hunt_id, matches, count, 1);
+    free(matches);
+}
 
-    Treasure treasure;
-    while (read(fd, &treasure, sizeof(treasure)) == sizeof(treasure)) {
-        char line[256];
-        snprintf(line, sizeof(line), "%s\t%s\t%.6f\t%.6f\t%d\n",
-               treasure.id, treasure.user,
-               treasure.latitude, treasure.longitude,
-               treasure.value);
-        strcat(output, line);
+void bbox_treasures(ResponseWriter *out, const char *hunt_id, double min_lat, double min_lon,
+                    double max_lat, double max_lon) {
+    GeoMatch *matches;
+    size_t count;
+    if (min_lat > max_lat || geo_query_box(hunt_id, min_lat, min_lon, max_lat, max_lon, &matches, &count) == -1) {
+        response_printf(out, "Error: Could not query hunt %s\n", hunt_id);
+        return;
     }
 
-    close(fd);
-    send_output(output);
+    response_printf(out, "=== Treasures in [%.6f, %.6f] - [%.6f, %.6f] ===\n", min_lat, min_lon, max_lat, max_lon);
+    send_matches(out, hunt_id, matches, count, 0);
+    free(matches);
 }
 
-void view_treasure(const char *hunt_id, const char *treasure_id) {
-    char path[256];
-    snprintf(path, sizeof(path), "hunts/%s/treasures.dat", hunt_id);
+// One row of a by_user reply, in the columns treasure_manager --by-user prints
+void send_owned_row(const char *hunt_id, const Treasure *treasure, void *arg) {
+    response_printf(arg, "%s\t%s\t%.6f\t%.6f\t%d\n", hunt_id, treasure->id,
+                    treasure->latitude, treasure->longitude, treasure->value);
+}
 
-    int fd = open(path, O_RDONLY);
-    if (fd == -1) {
-        send_output("Error: Could not open treasures file\n");
+// Streams a user's treasures across all hunts, read through the user index
+void by_user(ResponseWriter *out, const char *user) {
+    response_printf(out, "=== Treasures of User %s ===\n"
+                         "Hunt\tID\tLatitude\tLongitude\tValue\n"
+                         "--------------------------------------------------\n", user);
+    long found = user_index_find(user, send_owned_row, out);
+    if (found == -1) {
+        response_printf(out, "Error: Could not read user index\n");
         return;
     }
+    response_printf(out, "%ld treasure(s) found.\n", found);
+}
 
-    char output[1024] = {0};
-    Treasure treasure;
-    int found = 0;
-
-    while (read(fd, &treasure, sizeof(treasure)) == sizeof(treasure)) {
-        if (strcmp(treasure.id, treasure_id) == 0) {
-            found = 1;
-            snprintf(output, sizeof(output),
-                   "=== Treasure Details ===\n"
-                   "Hunt ID: %s\n"
-                   "Treasure ID: %s\n"
-                   "User: %s\n"
-                   "Coordinates: %.6f, %.6f\n"
-                   "Clue: %s\n"
-                   "Value: %d\n",
-                   hunt_id, treasure.id, treasure.user,
-                   treasure.latitude, treasure.longitude,
-                   treasure.clue, treasure.value);
-            break;
-        }
+// Answers from the running totals; the output matches calculate_score's
+void send_scores(ResponseWriter *out, const char *hunt_id, int top) {
+    ScoreTable table;
+    if (tally_scores(&score_tally, hunt_id, &table) == -1) {
+        response_printf(out, "Error: Could not open treasures file for hunt %s\n", hunt_id);
+        return;
     }
 
-    if (!found) {
-        snprintf(output, sizeof(output), "Treasure with ID %s not found in hunt %s\n", treasure_id, hunt_id);
+    score_table_rank(&table, top > 0 ? (size_t)top : 0);
+    response_printf(out, "=== Scores for Hunt %s ===\n", hunt_id);
+    for (size_t i = 0; i < table.count; i++) {
+        response_printf(out, "%s: %lld points\n", table.users[i].name, table.users[i].total);
     }
+    score_table_free(&table);
+}
 
-    close(fd);
-    send_output(output);
+void all_scores(ResponseWriter *out, int top) {
+    DIR *dir = opendir("hunts");
+    if (dir == NULL) {
+        response_printf(out, "Error: Could not open hunts directory\n");
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        // Hunts are the directories; the catalog and dot entries are not
+        if (entry->d_name[0] == '.' || (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN)) {
+            continue;
+        }
+        response_printf(out, "Calculating scores for hunt: %s\n", entry->d_name);
+        response_printf(out, "Score results:\n");
+        send_scores(out, entry->d_name, top);
+    }
+    closedir(dir);
 }
 
-void process_command(const char *cmd) {
-    char command[256];
+// Runs one command, streaming its reply to the client as it is produced
+void process_command(Connection *conn, const char *cmd, uint32_t request_id) {
     char hunt_id[256];
     char treasure_id[256];
+    char user[256];
+    double a, b, c, d;
+    int top = 0;
+
+    ResponseWriter *out = response_begin(conn->fd, &conn->write_lock, conn->ring, request_id);
+    if (!out) {
+        perror("response_begin");
+        return;
+    }
 
     if (strcmp(cmd, "list_hunts") == 0) {
-        list_hunts();
-    } else if (sscanf(cmd, "list_treasures %s", hunt_id) == 1) {
-        list_treasures(hunt_id);
-    } else if (sscanf(cmd, "view_treasure %s %s", hunt_id, treasure_id) == 2) {
-        view_treasure(hunt_id, treasure_id);
+        list_hunts(out);
+    } else if (sscanf(cmd, "list_treasures %255s", hunt_id) == 1) {
+        list_treasures(out, hunt_id);
+    } else if (sscanf(cmd, "view_treasure %255s %255s", hunt_id, treasure_id) == 2) {
+        view_treasure(out, hunt_id, treasure_id);
+    } else if (sscanf(cmd, "near_treasures %255s %lf %lf %lf", hunt_id, &a, &b, &c) == 4) {
+        near_treasures(out, hunt_id, a, b, c);
+    } else if (sscanf(cmd, "bbox_treasures %255s %lf %lf %lf %lf", hunt_id, &a, &b, &c, &d) == 5) {
+        bbox_treasures(out, hunt_id, a, b, c, d);
+    } else if (sscanf(cmd, "by_user %255s", user) == 1) {
+        by_user(out, user);
+    } else if (sscanf(cmd, "calculate_score %255s", hunt_id) == 1) {
+        sscanf(cmd, "calculate_score %*s --top %d", &top);
+        send_scores(out, hunt_id, top);
+    } else if (strncmp(cmd, "calculate_all_scores", 20) == 0) {
+        sscanf(cmd, "calculate_all_scores --top %d", &top);
+        all_scores(out, top);
     } else {
-        send_output("Error: Unknown command\n");
+        response_printf(out, "Error: Unknown command\n");
+    }
+
+    if (response_end(out) == -1) {
+        perror("send reply");
     }
 }
 
-int main() {
-    // Create named pipe for output
-    mkfifo(OUTPUT_PIPE, 0666);
+// Drops one reference; the last one closes the socket
+void release_connection(Connection *conn) {
+    pthread_mutex_lock(&job_queue.lock);
+    int last = --conn->refs == 0;
+    pthread_mutex_unlock(&job_queue.lock);
 
-    setup_signal_handlers();
+    if (last) {
+        ring_destroy(conn->ring);
+        for (int i = 0; i < conn->passed_count; i++) {
+            close(conn->passed_fds[i]);
+        }
+        close(conn->fd);
+        frame_lock_destroy(&conn->write_lock);
+        free(conn->input);
+        free(conn);
+    }
+}
 
+void *command_worker(void *arg) {
+    (void)arg;
     while (1) {
-        pause(); // Wait for signal
+        pthread_mutex_lock(&job_queue.lock);
+        while (!job_queue.head && !job_queue.stopping) {
+            pthread_cond_wait(&job_queue.ready, &job_queue.lock);
+        }
+        if (job_queue.stopping) {
+            pthread_mutex_unlock(&job_queue.lock);
+            break;
+        }
+        Job *job = job_queue.head;
+        job_queue.head = job->next;
+        if (!job_queue.head) {
+            job_queue.tail = NULL;
+        }
+        pthread_mutex_unlock(&job_queue.lock);
+
+        process_command(job->conn, job->cmd, job->request_id);
+        release_connection(job->conn);
+        free(job->cmd);
+        free(job);
+    }
+    return NULL;
+}
+
+// Queues a request for the workers. Returns 0, or -1 when out of memory.
+int queue_command(Connection *conn, uint32_t request_id, const char *payload, size_t length) {
+    Job *job = malloc(sizeof(Job));
+    char *cmd = malloc(length + 1);
+    if (!job || !cmd) {
+        free(job);
+        free(cmd);
+        return -1;
+    }
+    memcpy(cmd, payload, length);
+    cmd[length] = '\0';
+    job->conn = conn;
+    job->request_id = request_id;
+    job->cmd = cmd;
+    job->next = NULL;
+
+    pthread_mutex_lock(&job_queue.lock);
+    conn->refs++;
+    if (job_queue.tail) {
+        job_queue.tail->next = job;
+    } else {
+        job_queue.head = job;
+    }
+    job_queue.tail = job;
+    pthread_cond_signal(&job_queue.ready);
+    pthread_mutex_unlock(&job_queue.lock);
+    return 0;
+}
+
+void close_connection(int epoll_fd, Connection *conn) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    } else {
+        connections = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    }
+    // Replies still being produced finish before the socket closes
+    shutdown(conn->fd, SHUT_RD);
+    release_connection(conn);
+}
 
-        if (command_received) {
-            command_received = 0;
+void accept_connection(int epoll_fd, int listen_fd) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd == -1) {
+        if (errno != EINTR && errno != EAGAIN) {
+            perror("accept");
+        }
+        return;
+    }
 
-            // Read command from file
-            int fd = open(COMMAND_FILE, O_RDONLY);
-            if (fd == -1) {
-                send_output("Error: Could not open command file\n");
-                continue;
+    Connection *conn = calloc(1, sizeof(Connection));
+    if (!conn) {
+        close(fd);
+        return;
+    }
+    struct timeval timeout = { SEND_TIMEOUT_SEC, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    conn->fd = fd;
+    conn->refs = 1;
+    frame_lock_init(&conn->write_lock);
+
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = conn };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        perror("epoll_ctl");
+        release_connection(conn);
+        return;
+    }
+    conn->next = connections;
+    if (connections) {
+        connections->prev = conn;
+    }
+    connections = conn;
+}
+
+// Holds on to fds the client sent for a later attach_ring; any beyond what
+// that needs are closed
+void keep_passed_fds(Connection *conn, struct msghdr *msg) {
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (conn->passed_count < MAX_PASSED_FDS) {
+                conn->passed_fds[conn->passed_count++] = fd;
+            } else {
+                close(fd);
             }
+        }
+    }
+}
+
+// Switches the connection's replies to the ring whose fds came with the
+// attach_ring request. Answered here rather than by a worker, on the socket,
+// since the client waits for this reply before sending anything else.
+void attach_ring(Connection *conn, uint32_t request_id) {
+    Ring *ring = NULL;
+    if (!conn->ring && conn->passed_count == MAX_PASSED_FDS) {
+        ring = ring_attach(conn->passed_fds[0], conn->passed_fds[1], conn->passed_fds[2]);
+        if (!ring) {
+            perror("ring_attach");
+        }
+    } else {
+        for (int i = 0; i < conn->passed_count; i++) {
+            close(conn->passed_fds[i]);
+        }
+    }
+    conn->passed_count = 0;
+
+    const char *reply = ring ? "ok" : "Error: Cannot attach ring\n";
+    frame_lock_acquire(&conn->write_lock);
+    if (ring) {
+        conn->ring = ring;
+    }
+    if (frame_send(conn->fd, request_id, FRAME_END, reply, strlen(reply)) == -1) {
+        perror("send reply");
+    }
+    frame_lock_release(&conn->write_lock);
+}
 
-            char cmd[256];
-            ssize_t bytes = read(fd, cmd, sizeof(cmd)-1);
-            if (bytes > 0) {
-                cmd[bytes] = '\0';
-                process_command(cmd);
+// Reads whatever the client sent and queues each complete request. The socket
+// stays blocking for the workers' writes; reads here never wait.
+void read_requests(int epoll_fd, Connection *conn) {
+    while (1) {
+        if (conn->input_capacity - conn->input_length < READ_CHUNK) {
+            size_t capacity = conn->input_capacity + READ_CHUNK;
+            char *input = realloc(conn->input, capacity);
+            if (!input) {
+                perror("realloc");
+                close_connection(epoll_fd, conn);
+                return;
             }
+            conn->input = input;
+            conn->input_capacity = capacity;
+        }
 
-            close(fd);
+        struct iovec iov = { conn->input + conn->input_length, READ_CHUNK };
+        union {
+            struct cmsghdr align;
+            char buffer[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+        } control;
+        struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1,
+                              .msg_control = control.buffer, .msg_controllen = sizeof(control.buffer) };
+        ssize_t bytes = recvmsg(conn->fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        if (bytes > 0) {
+            keep_passed_fds(conn, &msg);
+        }
+        if (bytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
         }
+        if (bytes <= 0) {
+            if (bytes == -1) {
+                perror("read request");
+            }
+            close_connection(epoll_fd, conn);
+            return;
+        }
+        conn->input_length += bytes;
+    }
+
+    size_t used = 0;
+    FrameHeader header;
+    ssize_t frame;
+    while ((frame = frame_parse(conn->input + used, conn->input_length - used, &header)) > 0) {
+        const char *payload = conn->input + used + sizeof(FrameHeader);
+        if (header.length == 11 && memcmp(payload, "attach_ring", 11) == 0) {
+            attach_ring(conn, header.request_id);
+        } else if (queue_command(conn, header.request_id, payload, header.length) == -1) {
+            perror("queue request");
+        }
+        used += frame;
+    }
+    if (frame == -1) {
+        perror("read request");
+        close_connection(epoll_fd, conn);
+        return;
+    }
+
+    memmove(conn->input, conn->input + used, conn->input_length - used);
+    conn->input_length -= used;
+}
+
+// Worker count follows the cores, with at least two so one slow query never
+// holds up everything else
+size_t worker_count() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t workers = cores > 0 ? (size_t)cores : 1;
+    if (workers < MIN_WORKERS) {
+        workers = MIN_WORKERS;
+    }
+    return workers > MAX_WORKERS ? MAX_WORKERS : workers;
+}
+
+int main() {
+    int listen_fd = protocol_listen(MONITOR_SOCKET);
+    if (listen_fd == -1) {
+        perror("listen");
+        return 1;
+    }
+
+    int signal_fd = setup_signal_handlers();
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = &listen_fd };
+    if (signal_fd == -1 || epoll_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) == -1) {
+        perror("event loop setup");
+        return 1;
+    }
+    event.data.ptr = &signal_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event);
+
+    hunt_cache_init(&hunt_cache);
+    tally_init(&score_tally);
+
+    // Workers inherit the blocked signal mask
+    pthread_t workers[MAX_WORKERS];
+    size_t started = 0;
+    for (size_t count = worker_count(); started < count; started++) {
+        if (pthread_create(&workers[started], NULL, command_worker, NULL) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        perror("pthread_create");
+        return 1;
+    }
+
+    int stop_requested = 0;
+    while (!stop_requested) {
+        struct epoll_event events[MAX_EVENTS];
+        int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (ready == -1) {
+            if (errno != EINTR) {
+                perror("epoll_wait");
+                break;
+            }
+            continue;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.ptr == &signal_fd) {
+                stop_requested = 1;
+            } else if (events[i].data.ptr == &listen_fd) {
+                accept_connection(epoll_fd, listen_fd);
+            } else {
+                read_requests(epoll_fd, events[i].data.ptr);
+            }
+        }
+    }
+
+    // Running commands finish; queued ones are dropped
+    pthread_mutex_lock(&job_queue.lock);
+    job_queue.stopping = 1;
+    pthread_cond_broadcast(&job_queue.ready);
+    pthread_mutex_unlock(&job_queue.lock);
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    while (job_queue.head) {
+        Job *job = job_queue.head;
+        job_queue.head = job->next;
+        release_connection(job->conn);
+        free(job->cmd);
+        free(job);
+    }
+    while (connections) {
+        close_connection(epoll_fd, connections);
     }
 
-    close(output_fd);
-    unlink(OUTPUT_PIPE);
+    hunt_cache_free(&hunt_cache);
+    tally_free(&score_tally);
+    close(epoll_fd);
+    close(signal_fd);
+    close(listen_fd);
+    unlink(MONITOR_SOCKET);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "treasure_protocol.h"
+#include "treasure_ring.h"
+
+static int read_full(int fd, void *buffer, size_t length) {
+    char *p = buffer;
+    while (length > 0) {
+        ssize_t bytes = read(fd, p, length);
+        if (bytes == 0) {
+            return 0;
+        }
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += bytes;
+        length -= bytes;
+    }
+    return 1;
+}
+
+int frame_send(int fd, uint32_t request_id, uint32_t flags, const void *payload, uint32_t length) {
+    FrameHeader header = { length, request_id, flags };
+    struct iovec iov[2] = {
+        { &header, sizeof(header) },
+        { (void *)payload, length }
+    };
+    int iovcnt = length > 0 ? 2 : 1;
+    struct iovec *cur = iov;
+
+    // Finish partial writes without splitting the frame across other writers' data
+    while (iovcnt > 0) {
+        ssize_t bytes = writev(fd, cur, iovcnt);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        while (iovcnt > 0 && (size_t)bytes >= cur->iov_len) {
+            bytes -= cur->iov_len;
+            cur++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            cur->iov_base = (char *)cur->iov_base + bytes;
+            cur->iov_len -= bytes;
+        }
+    }
+    return 0;
+}
+
+int frame_send_fds(int fd, uint32_t request_id, const void *payload, uint32_t length, const int *fds, int count) {
+    FrameHeader header = { length, request_id, 0 };
+    struct iovec iov[2] = {
+        { &header, sizeof(header) },
+        { (void *)payload, length }
+    };
+    union {
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int) * 4)];
+    } control;
+    if (count > 4) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = length > 0 ? 2 : 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+
+    ssize_t bytes;
+    while ((bytes = sendmsg(fd, &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR) {
+    }
+    if (bytes == -1) {
+        return -1;
+    }
+    // The fds travel with the first byte; finish a short write without them
+    size_t sent = bytes;
+    while (sent < sizeof(header) + length) {
+        const char *from = sent < sizeof(header) ? (const char *)&header + sent
+                                                 : (const char *)payload + (sent - sizeof(header));
+        size_t left = sent < sizeof(header) ? sizeof(header) - sent : sizeof(header) + length - sent;
+        bytes = write(fd, from, left);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        sent += bytes;
+    }
+    return 0;
+}
+
+ssize_t frame_parse(const char *data, size_t length, FrameHeader *header) {
+    if (length < sizeof(FrameHeader)) {
+        return 0;
+    }
+    memcpy(header, data, sizeof(FrameHeader));
+    if (header->length > MAX_FRAME_LEN) {
+        errno = EPROTO;
+        return -1;
+    }
+    size_t total = sizeof(FrameHeader) + header->length;
+    return length < total ? 0 : (ssize_t)total;
+}
+
+int frame_recv(int fd, FrameHeader *header, char **payload) {
+    int result = read_full(fd, header, sizeof(FrameHeader));
+    if (result <= 0) {
+        return result;
+    }
+    if (header->length > MAX_FRAME_LEN) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    char *buffer = malloc(header->length + 1);
+    if (!buffer) {
+        return -1;
+    }
+    if (header->length > 0 && read_full(fd, buffer, header->length) != 1) {
+        free(buffer);
+        errno = EPROTO;
+        return -1;
+    }
+    buffer[header->length] = '\0';
+    *payload = buffer;
+    return 1;
+}
+
+static void fill_address(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strncpy(addr->sun_path, path, sizeof(addr->sun_path) - 1);
+}
+
+int protocol_listen(const char *path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+
+    struct sockaddr_un addr;
+    fill_address(&addr, path);
+    unlink(path); // stale socket from a previous run
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, 16) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int protocol_connect(const char *path, int timeout_ms) {
+    struct sockaddr_un addr;
+    fill_address(&addr, path);
+
+    struct timespec delay = { 0, 1000000 }; // 1 ms, doubled per attempt
+    int waited_ms = 0;
+
+    while (1) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            return fd;
+        }
+
+        int saved = errno;
+        close(fd);
+        if ((saved != ENOENT && saved != ECONNREFUSED) || waited_ms >= timeout_ms) {
+            errno = saved;
+            return -1;
+        }
+
+        nanosleep(&delay, NULL);
+        waited_ms += delay.tv_nsec / 1000000;
+        if (delay.tv_nsec < 64000000) {
+            delay.tv_nsec *= 2;
+        }
+    }
+}
+
+void frame_lock_init(FrameLock *lock) {
+    pthread_mutex_init(&lock->mutex, NULL);
+    pthread_cond_init(&lock->turn, NULL);
+    lock->next = 0;
+    lock->serving = 0;
+}
+
+void frame_lock_acquire(FrameLock *lock) {
+    pthread_mutex_lock(&lock->mutex);
+    uint64_t ticket = lock->next++;
+    while (ticket != lock->serving) {
+        pthread_cond_wait(&lock->turn, &lock->mutex);
+    }
+    pthread_mutex_unlock(&lock->mutex);
+}
+
+void frame_lock_release(FrameLock *lock) {
+    pthread_mutex_lock(&lock->mutex);
+    lock->serving++;
+    pthread_cond_broadcast(&lock->turn);
+    pthread_mutex_unlock(&lock->mutex);
+}
+
+void frame_lock_destroy(FrameLock *lock) {
+    pthread_mutex_destroy(&lock->mutex);
+    pthread_cond_destroy(&lock->turn);
+}
+
+static void response_flush(ResponseWriter *writer, uint32_t flags) {
+    if (!writer->failed) {
+        if (writer->lock) {
+            frame_lock_acquire(writer->lock);
+        }
+        int result = writer->ring
+            ? ring_send_frame(writer->ring, writer->request_id, flags, writer->buffer, writer->length,
+                              writer->fd, RING_SEND_TIMEOUT_MS)
+            : frame_send(writer->fd, writer->request_id, flags, writer->buffer, writer->length);
+        if (result == -1) {
+            // Keep consuming output, but hang up: a client still waiting for
+            // this reply's FRAME_END would otherwise wait forever
+            writer->failed = 1;
+            shutdown(writer->fd, SHUT_RDWR);
+        }
+        if (writer->lock) {
+            frame_lock_release(writer->lock);
+        }
+    }
+    writer->length = 0;
+}
+
+ResponseWriter *response_begin(int fd, FrameLock *lock, struct Ring *ring, uint32_t request_id) {
+    ResponseWriter *writer = malloc(sizeof(ResponseWriter));
+    if (writer) {
+        writer->fd = fd;
+        writer->lock = lock;
+        writer->ring = ring;
+        writer->request_id = request_id;
+        writer->length = 0;
+        writer->failed = 0;
+    }
+    return writer;
+}
+
+void response_write(ResponseWriter *writer, const char *data, size_t length) {
+    while (length > 0) {
+        size_t room = RESPONSE_CHUNK - writer->length;
+        size_t n = length < room ? length : room;
+        memcpy(writer->buffer + writer->length, data, n);
+        writer->length += n;
+        data += n;
+        length -= n;
+        if (writer->length == RESPONSE_CHUNK) {
+            response_flush(writer, 0);
+        }
+    }
+}
+
+void response_printf(ResponseWriter *writer, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    size_t room = RESPONSE_CHUNK - writer->length;
+    int length = vsnprintf(writer->buffer + writer->length, room, format, args);
+    va_end(args);
+
+    if (length < 0) {
+        return;
+    }
+    if ((size_t)length < room) {
+        writer->length += length;
+        return;
+    }
+
+    // Did not fit: format into a temporary and copy it across chunks
+    char *text = malloc(length + 1);
+    if (!text) {
+        return;
+    }
+    va_start(args, format);
+    vsnprintf(text, length + 1, format, args);
+    va_end(args);
+    response_write(writer, text, length);
+    free(text);
+}
+
+int response_end(ResponseWriter *writer) {
+    response_flush(writer, FRAME_END);
+    int result = writer->failed ? -1 : 0;
+    free(writer);
+    return result;
+}
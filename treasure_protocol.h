@@ -0,0 +1,89 @@
+#ifndef TREASURE_PROTOCOL_H
+#define TREASURE_PROTOCOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+// Request/response protocol between treasure_hub and treasure_monitor over a
+// Unix-domain stream socket. Every message is a frame: a fixed header followed
+// by `length` payload bytes. Requests carry a command line; a response is one
+// or more frames tagged with the request's ID, the last one flagged FRAME_END.
+// Clients may pipeline any number of requests before reading the replies, and
+// the monitor may answer them out of order with their frames interleaved.
+
+#define MONITOR_SOCKET "/tmp/treasure_monitor.sock"
+#define FRAME_END 0x1
+#define MAX_FRAME_LEN (16 * 1024 * 1024)
+
+typedef struct {
+    uint32_t length;
+    uint32_t request_id;
+    uint32_t flags;
+} FrameHeader;
+
+// Serializes frames from several writers on one fd in arrival order, so a
+// long reply cannot keep the fd to itself while shorter ones wait
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t turn;
+    uint64_t next;    // next ticket to hand out
+    uint64_t serving; // ticket allowed to write
+} FrameLock;
+
+void frame_lock_init(FrameLock *lock);
+void frame_lock_acquire(FrameLock *lock);
+void frame_lock_release(FrameLock *lock);
+void frame_lock_destroy(FrameLock *lock);
+
+// Streams one response as a series of frames. Output is collected in a fixed
+// chunk and sent whenever the chunk fills, so replies of any size take linear
+// time and bounded memory; response_end sends the final FRAME_END frame.
+#define RESPONSE_CHUNK (64 * 1024)
+
+struct Ring;
+
+typedef struct {
+    int fd;
+    FrameLock *lock;   // held around each frame when fd is shared, or NULL
+    struct Ring *ring; // carries the frames instead of fd when set (treasure_ring.h)
+    uint32_t request_id;
+    size_t length;
+    int failed;
+    char buffer[RESPONSE_CHUNK];
+} ResponseWriter;
+
+// Allocates a writer for the reply to request_id on fd, or on ring when the
+// client attached one; NULL when out of memory. Writers for other requests on
+// the same fd must pass the same lock.
+ResponseWriter *response_begin(int fd, FrameLock *lock, struct Ring *ring, uint32_t request_id);
+void response_write(ResponseWriter *writer, const char *data, size_t length);
+void response_printf(ResponseWriter *writer, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+// Sends whatever is buffered as the last frame and frees the writer. Returns 0 or -1.
+int response_end(ResponseWriter *writer);
+
+// Writes header and payload with a single writev. Returns 0 or -1.
+int frame_send(int fd, uint32_t request_id, uint32_t flags, const void *payload, uint32_t length);
+
+// Like frame_send for a request frame, passing fds along with it (SCM_RIGHTS).
+// Returns 0 or -1.
+int frame_send_fds(int fd, uint32_t request_id, const void *payload, uint32_t length, const int *fds, int count);
+
+// Decodes the frame at the start of a receive buffer holding length bytes.
+// Returns the frame's total size once all of it is buffered, 0 while more
+// bytes are needed, or -1 if the header is invalid.
+ssize_t frame_parse(const char *data, size_t length, FrameHeader *header);
+
+// Reads one frame; *payload is malloc'd, NUL-terminated and owned by the caller.
+// Returns 1 on success, 0 on orderly EOF, -1 on error.
+int frame_recv(int fd, FrameHeader *header, char **payload);
+
+// Creates, binds and listens on the socket at path. Returns the fd or -1.
+int protocol_listen(const char *path);
+
+// Connects to path, retrying while the server is still starting up for up to
+// timeout_ms. Returns the fd or -1.
+int protocol_connect(const char *path, int timeout_ms);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,267 @@
+#define _GNU_SOURCE // memfd_create, POLLRDHUP
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "treasure_ring.h"
+
+#define RING_MAGIC 0x474e495254ull // "TRING"
+#define CONTROL_SIZE 4096
+
+// Lives at the start of the memfd; head and tail on their own cache lines
+typedef struct {
+    uint64_t magic;
+    uint64_t capacity;
+    char padding1[48];
+    _Atomic uint64_t head; // bytes ever written
+    char padding2[56];
+    _Atomic uint64_t tail; // bytes ever consumed
+    char padding3[56];
+    _Atomic uint32_t reader_waiting;
+    _Atomic uint32_t writer_waiting;
+} RingControl;
+
+struct Ring {
+    int memfd;
+    int data_fd;  // signalled by the producer when it publishes
+    int space_fd; // signalled by the consumer when it frees space
+    RingControl *control;
+    char *data;
+    size_t capacity;
+    size_t mapped;
+};
+
+static Ring *ring_map(int memfd, int data_fd, int space_fd) {
+    struct stat st;
+    if (fstat(memfd, &st) == -1 || st.st_size <= CONTROL_SIZE) {
+        return NULL;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+
+    RingControl *control = base;
+    size_t capacity = control->capacity;
+    Ring *ring = malloc(sizeof(Ring));
+    if (!ring || control->magic != RING_MAGIC || capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        (size_t)st.st_size != CONTROL_SIZE + capacity) {
+        munmap(base, st.st_size);
+        free(ring);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ring->memfd = memfd;
+    ring->data_fd = data_fd;
+    ring->space_fd = space_fd;
+    ring->control = control;
+    ring->data = (char *)base + CONTROL_SIZE;
+    ring->capacity = capacity;
+    ring->mapped = st.st_size;
+    return ring;
+}
+
+Ring *ring_create(size_t capacity) {
+    int memfd = memfd_create("treasure_ring", MFD_CLOEXEC);
+    int data_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    int space_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    Ring *ring = NULL;
+    if (memfd != -1 && data_fd != -1 && space_fd != -1 && ftruncate(memfd, CONTROL_SIZE + capacity) == 0) {
+        RingControl control;
+        memset(&control, 0, sizeof(control));
+        control.magic = RING_MAGIC;
+        control.capacity = capacity;
+        if (pwrite(memfd, &control, sizeof(control), 0) == sizeof(control)) {
+            ring = ring_map(memfd, data_fd, space_fd);
+        }
+    }
+
+    if (!ring) {
+        if (memfd != -1) {
+            close(memfd);
+        }
+        if (data_fd != -1) {
+            close(data_fd);
+        }
+        if (space_fd != -1) {
+            close(space_fd);
+        }
+    }
+    return ring;
+}
+
+Ring *ring_attach(int memfd, int data_fd, int space_fd) {
+    Ring *ring = ring_map(memfd, data_fd, space_fd);
+    if (!ring) {
+        close(memfd);
+        close(data_fd);
+        close(space_fd);
+    }
+    return ring;
+}
+
+void ring_destroy(Ring *ring) {
+    if (ring) {
+        munmap(ring->control, ring->mapped);
+        close(ring->memfd);
+        close(ring->data_fd);
+        close(ring->space_fd);
+        free(ring);
+    }
+}
+
+Ring *ring_connect(int sock, uint32_t request_id) {
+    Ring *ring = ring_create(RING_CAPACITY);
+    if (!ring) {
+        return NULL;
+    }
+
+    int fds[3] = { ring->memfd, ring->data_fd, ring->space_fd };
+    const char *cmd = "attach_ring";
+    FrameHeader header;
+    char *reply;
+    if (frame_send_fds(sock, request_id, cmd, strlen(cmd), fds, 3) == -1 || frame_recv(sock, &header, &reply) != 1) {
+        ring_destroy(ring);
+        return NULL;
+    }
+
+    // A monitor that does not know the request says so and keeps using the socket
+    int attached = header.request_id == request_id && strcmp(reply, "ok") == 0;
+    free(reply);
+    if (!attached) {
+        ring_destroy(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+static void signal_event(int fd) {
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        perror("eventfd write");
+    }
+}
+
+// Sleeps on event_fd until the other side signals it or peer_fd hangs up.
+// Returns 1 when woken, 0 on hangup or timeout, -1 on error.
+static int wait_event(int event_fd, int peer_fd, int timeout_ms) {
+    struct pollfd fds[2] = {
+        { event_fd, POLLIN, 0 },
+        { peer_fd, POLLRDHUP, 0 }
+    };
+    int ready = poll(fds, 2, timeout_ms);
+    if (ready == -1) {
+        return errno == EINTR ? 1 : -1;
+    }
+    if (fds[0].revents & POLLIN) {
+        uint64_t count;
+        if (read(event_fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+            return -1;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// Copies length bytes into the data area at position, wrapping at its end
+static void copy_in(Ring *ring, uint64_t position, const void *data, size_t length) {
+    size_t start = position & (ring->capacity - 1);
+    size_t first = ring->capacity - start < length ? ring->capacity - start : length;
+    memcpy(ring->data + start, data, first);
+    memcpy(ring->data, (const char *)data + first, length - first);
+}
+
+int ring_send_frame(Ring *ring, uint32_t request_id, uint32_t flags, const void *payload, uint32_t length,
+                    int peer_fd, int timeout_ms) {
+    RingControl *control = ring->control;
+    size_t total = sizeof(FrameHeader) + length;
+    if (total > ring->capacity) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    // Only this side moves head
+    uint64_t head = atomic_load_explicit(&control->head, memory_order_relaxed);
+    while (head - atomic_load(&control->tail) > ring->capacity - total) {
+        atomic_store(&control->writer_waiting, 1);
+        if (head - atomic_load(&control->tail) <= ring->capacity - total) {
+            break; // space was freed before the flag went up
+        }
+        int woken = wait_event(ring->space_fd, peer_fd, timeout_ms);
+        if (woken <= 0) {
+            if (woken == 0) {
+                errno = EPIPE;
+            }
+            return -1;
+        }
+    }
+    atomic_store(&control->writer_waiting, 0);
+
+    FrameHeader header = { length, request_id, flags };
+    copy_in(ring, head, &header, sizeof(header));
+    copy_in(ring, head + sizeof(header), payload, length);
+
+    // Publish the whole frame at once, then wake the reader if it sleeps
+    atomic_store(&control->head, head + total);
+    if (atomic_exchange(&control->reader_waiting, 0)) {
+        signal_event(ring->data_fd);
+    }
+    return 0;
+}
+
+int ring_recv_frame(Ring *ring, FrameHeader *header, RingSlice slices[2], int peer_fd) {
+    RingControl *control = ring->control;
+
+    // Only this side moves tail
+    uint64_t tail = atomic_load_explicit(&control->tail, memory_order_relaxed);
+    while (atomic_load(&control->head) == tail) {
+        atomic_store(&control->reader_waiting, 1);
+        if (atomic_load(&control->head) != tail) {
+            break; // a frame was published before the flag went up
+        }
+        int woken = wait_event(ring->data_fd, peer_fd, -1);
+        if (woken <= 0) {
+            // Frames published just before the hangup still count
+            if (woken == 0 && atomic_load(&control->head) != tail) {
+                continue;
+            }
+            return woken;
+        }
+    }
+    atomic_store(&control->reader_waiting, 0);
+
+    size_t mask = ring->capacity - 1;
+    char raw[sizeof(FrameHeader)];
+    for (size_t i = 0; i < sizeof(FrameHeader); i++) {
+        raw[i] = ring->data[(tail + i) & mask];
+    }
+    memcpy(header, raw, sizeof(FrameHeader));
+    if (sizeof(FrameHeader) + header->length > ring->capacity) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    size_t start = (tail + sizeof(FrameHeader)) & mask;
+    size_t first = ring->capacity - start < header->length ? ring->capacity - start : header->length;
+    slices[0].data = ring->data + start;
+    slices[0].length = first;
+    slices[1].data = ring->data;
+    slices[1].length = header->length - first;
+    return 1;
+}
+
+void ring_consume(Ring *ring, const FrameHeader *header) {
+    RingControl *control = ring->control;
+    uint64_t tail = atomic_load_explicit(&control->tail, memory_order_relaxed);
+    atomic_store(&control->tail, tail + sizeof(FrameHeader) + header->length);
+    if (atomic_exchange(&control->writer_waiting, 0)) {
+        signal_event(ring->space_fd);
+    }
+}
\ No newline at end of file
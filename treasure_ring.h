@@ -0,0 +1,70 @@
+#ifndef TREASURE_RING_H
+#define TREASURE_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "treasure_protocol.h"
+
+// Shared-memory ring carrying the monitor's reply frames to treasure_hub, in
+// place of the socket.
+//
+// The hub creates the ring (a memfd holding a control block and the data
+// area) and two eventfds, and passes all three to the monitor with an
+// attach_ring request over the socket (ring_connect). From then on the
+// monitor's replies are written into the ring as frames, in the same format
+// as on the socket, and the socket carries only requests.
+//
+// There is one producer at a time (replies take turns on the connection's
+// FrameLock) and one consumer, so head and tail are plain atomic counters.
+// A side only sleeps when the ring is empty (hub) or full (monitor); before
+// sleeping it raises its waiting flag, and the other side signals its eventfd
+// only when it finds the flag raised. A frame is published whole, so the hub
+// reads every byte of a reply straight out of the mapping: the monitor's copy
+// into the ring is the only one.
+//
+// Waits also watch the socket, so either side gives up once the other has
+// gone away. A reply that cannot be sent in full hangs the socket up, so the
+// hub stops waiting for the rest of it.
+
+#define RING_CAPACITY (4 * 1024 * 1024)
+// How long a reply waits for the hub to make room before giving up
+#define RING_SEND_TIMEOUT_MS 30000
+
+typedef struct Ring Ring;
+
+// Part of a frame's payload inside the ring; a payload that wraps around the
+// end of the data area comes in two
+typedef struct {
+    const char *data;
+    size_t length;
+} RingSlice;
+
+// Creates a ring with capacity bytes of data (a power of two). Returns NULL
+// on failure.
+Ring *ring_create(size_t capacity);
+
+// Maps a ring from the fds received with attach_ring, taking ownership of
+// them. Returns NULL if they do not describe a ring.
+Ring *ring_attach(int memfd, int data_fd, int space_fd);
+
+void ring_destroy(Ring *ring);
+
+// Asks the monitor on sock to reply through a new ring; request_id tags the
+// attach_ring request. Returns the ring, or NULL if the monitor refused, in
+// which case replies keep coming over the socket.
+Ring *ring_connect(int sock, uint32_t request_id);
+
+// Appends one frame, waiting while the ring is full for at most timeout_ms
+// or until peer_fd hangs up. Returns 0 or -1.
+int ring_send_frame(Ring *ring, uint32_t request_id, uint32_t flags, const void *payload, uint32_t length,
+                    int peer_fd, int timeout_ms);
+
+// Waits for the next frame. Its payload stays in the ring, described by
+// slices, until ring_consume. Returns 1, 0 once peer_fd has hung up with
+// the ring drained, or -1 on error.
+int ring_recv_frame(Ring *ring, FrameHeader *header, RingSlice slices[2], int peer_fd);
+
+// Frees the space of the frame last returned by ring_recv_frame
+void ring_consume(Ring *ring, const FrameHeader *header);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "treasure_map.h"
+#include "treasure_columns.h"
+#include "treasure_aggregate.h"
+#include "treasure_score.h"
+
+#define INITIAL_USERS 64
+
+static uint32_t hash_name(const char *name) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < MAX_NAME_LEN && name[i] != '\0'; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Doubles the slot array and reinserts every interned user
+static int grow_slots(ScoreTable *table) {
+    size_t slot_count = table->slot_count ? table->slot_count * 2 : INITIAL_USERS * 2;
+    UserSlot *slots = calloc(slot_count, sizeof(UserSlot));
+    if (!slots) {
+        return -1;
+    }
+
+    size_t mask = slot_count - 1;
+    for (size_t i = 0; i < table->slot_count; i++) {
+        if (table->slots[i].user == 0) {
+            continue;
+        }
+        size_t j = table->slots[i].hash & mask;
+        while (slots[j].user != 0) {
+            j = (j + 1) & mask;
+        }
+        slots[j] = table->slots[i];
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->slot_count = slot_count;
+    return 0;
+}
+
+long score_table_intern(ScoreTable *table, const char *user) {
+    if ((table->count + 1) * 2 > table->slot_count && grow_slots(table) == -1) {
+        return -1;
+    }
+
+    uint32_t hash = hash_name(user);
+    size_t mask = table->slot_count - 1;
+    size_t i = hash & mask;
+
+    for (; table->slots[i].user != 0; i = (i + 1) & mask) {
+        UserScore *score = &table->users[table->slots[i].user - 1];
+        if (table->slots[i].hash == hash && strncmp(score->name, user, MAX_NAME_LEN) == 0) {
+            return table->slots[i].user - 1;
+        }
+    }
+
+    if (table->count == table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : INITIAL_USERS;
+        UserScore *users = realloc(table->users, capacity * sizeof(UserScore));
+        if (!users) {
+            return -1;
+        }
+        table->users = users;
+        table->capacity = capacity;
+    }
+
+    UserScore *score = &table->users[table->count++];
+    strncpy(score->name, user, MAX_NAME_LEN - 1);
+    score->name[MAX_NAME_LEN - 1] = '\0';
+    score->total = 0;
+
+    table->slots[i].hash = hash;
+    table->slots[i].user = table->count;
+    return table->count - 1;
+}
+
+int score_table_add(ScoreTable *table, const char *user, long long value) {
+    long i = score_table_intern(table, user);
+    if (i == -1) {
+        return -1;
+    }
+    table->users[i].total += value;
+    return 0;
+}
+
+// Aggregates the value column per dictionary ID, then interns each user once
+static int score_columns(const ColumnSet *columns, ScoreTable *table) {
+    UserAggregate *totals = malloc((columns->users + 1) * sizeof(UserAggregate));
+    if (!totals) {
+        return -1;
+    }
+
+    aggregate_reset(totals, columns->users);
+    AggregateKernel kernel = aggregate_kernel(columns->user, columns->records);
+    aggregate_values(kernel, columns->user, columns->value, columns->records, totals, columns->users);
+
+    int result = 0;
+    for (size_t u = 0; u < columns->users && result == 0; u++) {
+        if (totals[u].count > 0) {
+            result = score_table_add(table, columns->names[u], totals[u].sum);
+        }
+    }
+
+    free(totals);
+    if (result == -1) {
+        score_table_free(table);
+    }
+    return result;
+}
+
+int score_hunt(const char *hunt_id, ScoreTable *table) {
+    memset(table, 0, sizeof(ScoreTable));
+
+    // Up-to-date columns avoid reading whole records
+    ColumnSet columns;
+    if (columns_open(hunt_id, &columns) == 0) {
+        int result = score_columns(&columns, table);
+        columns_close(&columns);
+        return result;
+    }
+
+    TreasureMap map;
+    if (treasure_map_open(hunt_id, &map) == -1) {
+        return -1;
+    }
+
+    const Treasure *treasure;
+    while ((treasure = treasure_map_next(&map, NULL)) != NULL) {
+        if (!treasure_is_live(treasure)) {
+            continue;
+        }
+        if (score_table_add(table, treasure->user, treasure->value) == -1) {
+            treasure_map_close(&map);
+            score_table_free(table);
+            return -1;
+        }
+    }
+
+    treasure_map_close(&map);
+    return 0;
+}
+
+// Negative when a ranks ahead of b
+static int compare_rank(const UserScore *a, const UserScore *b) {
+    if (a->total != b->total) {
+        return a->total > b->total ? -1 : 1;
+    }
+    return strncmp(a->name, b->name, MAX_NAME_LEN);
+}
+
+static int compare_rank_qsort(const void *a, const void *b) {
+    return compare_rank(a, b);
+}
+
+// Sifts down a min-heap whose root is the weakest of the current leaders
+static void sift_down(UserScore *heap, size_t size, size_t i) {
+    while (1) {
+        size_t weakest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < size && compare_rank(&heap[left], &heap[weakest]) > 0) {
+            weakest = left;
+        }
+        if (right < size && compare_rank(&heap[right], &heap[weakest]) > 0) {
+            weakest = right;
+        }
+        if (weakest == i) {
+            return;
+        }
+        UserScore temp = heap[i];
+        heap[i] = heap[weakest];
+        heap[weakest] = temp;
+        i = weakest;
+    }
+}
+
+// Rebuilds the name slots after users have been moved or dropped
+static void reindex(ScoreTable *table) {
+    memset(table->slots, 0, table->slot_count * sizeof(UserSlot));
+    size_t mask = table->slot_count - 1;
+    for (size_t u = 0; u < table->count; u++) {
+        uint32_t hash = hash_name(table->users[u].name);
+        size_t i = hash & mask;
+        while (table->slots[i].user != 0) {
+            i = (i + 1) & mask;
+        }
+        table->slots[i].hash = hash;
+        table->slots[i].user = u + 1;
+    }
+}
+
+void score_table_rank(ScoreTable *table, size_t top) {
+    if (top > 0 && top < table->count) {
+        // The first `top` users become the heap; every later user that beats
+        // the weakest leader replaces it. O(n log top) instead of O(n log n).
+        UserScore *heap = table->users;
+        for (size_t i = top / 2; i-- > 0;) {
+            sift_down(heap, top, i);
+        }
+        for (size_t u = top; u < table->count; u++) {
+            if (compare_rank(&table->users[u], &heap[0]) < 0) {
+                heap[0] = table->users[u];
+                sift_down(heap, top, 0);
+            }
+        }
+        table->count = top;
+    }
+
+    qsort(table->users, table->count, sizeof(UserScore), compare_rank_qsort);
+    if (table->slots) {
+        reindex(table);
+    }
+}
+
+void score_table_print(const char *hunt_id, const ScoreTable *table, FILE *out) {
+    fprintf(out, "=== Scores for Hunt %s ===\n", hunt_id);
+    for (size_t i = 0; i < table->count; i++) {
+        fprintf(out, "%s: %lld points\n", table->users[i].name, table->users[i].total);
+    }
+}
+
+void score_table_free(ScoreTable *table) {
+    free(table->users);
+    free(table->slots);
+    memset(table, 0, sizeof(ScoreTable));
+}
+
+int score_table_export(const ScoreTable *table, int fd) {
+    size_t length = sizeof(ScoreResultHeader) + table->count * sizeof(ScoreResult);
+    if (ftruncate(fd, length) == -1) {
+        return -1;
+    }
+    char *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+
+    ScoreResultHeader *header = (ScoreResultHeader *)base;
+    memcpy(header->magic, SCORE_RESULT_MAGIC, 4);
+    header->count = table->count;
+    ScoreResult *results = (ScoreResult *)(base + sizeof(ScoreResultHeader));
+    for (size_t i = 0; i < table->count; i++) {
+        memcpy(results[i].user, table->users[i].name, MAX_NAME_LEN);
+        results[i].total = table->users[i].total;
+    }
+
+    munmap(base, length);
+    return 0;
+}
+
+int score_result_print(const char *hunt_id, int fd, FILE *out) {
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(ScoreResultHeader)) {
+        return -1;
+    }
+    char *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+
+    const ScoreResultHeader *header = (const ScoreResultHeader *)base;
+    if (memcmp(header->magic, SCORE_RESULT_MAGIC, 4) != 0 ||
+        (size_t)st.st_size < sizeof(ScoreResultHeader) + header->count * sizeof(ScoreResult)) {
+        munmap(base, st.st_size);
+        return -1;
+    }
+
+    const ScoreResult *results = (const ScoreResult *)(base + sizeof(ScoreResultHeader));
+    fprintf(out, "=== Scores for Hunt %s ===\n", hunt_id);
+    for (uint32_t i = 0; i < header->count; i++) {
+        fprintf(out, "%.*s: %lld points\n", MAX_NAME_LEN, results[i].user, (long long)results[i].total);
+    }
+
+    munmap(base, st.st_size);
+    return 0;
+}
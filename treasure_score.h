@@ -0,0 +1,80 @@
+#ifndef TREASURE_SCORE_H
+#define TREASURE_SCORE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "treasure.h"
+
+// In-process scoring engine shared by calculate_score and treasure_hub.
+// Thread-safe: each call works on its own table.
+
+typedef struct {
+    char name[MAX_NAME_LEN];
+    long long total;
+} UserScore;
+
+// Open-addressing slot: hash of the user name and 1-based index into users
+typedef struct {
+    uint32_t hash;
+    uint32_t user;
+} UserSlot;
+
+// Users are interned once in `users`; `slots` maps names to them in O(1)
+typedef struct {
+    UserScore *users;
+    size_t count;
+    size_t capacity;
+    UserSlot *slots;
+    size_t slot_count; // power of two, kept at most half full
+} ScoreTable;
+
+// Sums treasure values per user for one hunt, from its columns when they are
+// current and from treasures.dat otherwise. Returns 0, or -1 if the hunt's
+// treasures file cannot be read.
+int score_hunt(const char *hunt_id, ScoreTable *table);
+
+// Returns the user's position in table->users, interning it with a zero total
+// on first sight, or -1 when out of memory. Positions are stable until the
+// table is ranked.
+long score_table_intern(ScoreTable *table, const char *user);
+
+// Adds value to user's total, interning the user on first sight. Returns 0,
+// or -1 when out of memory.
+int score_table_add(ScoreTable *table, const char *user, long long value);
+
+// Orders users by descending total, ties by name. With top > 0 only the top
+// leaders are kept, picked with a bounded min-heap instead of a full sort.
+void score_table_rank(ScoreTable *table, size_t top);
+
+// Writes the report calculate_score has always printed
+void score_table_print(const char *hunt_id, const ScoreTable *table, FILE *out);
+
+void score_table_free(ScoreTable *table);
+
+// Binary form of a ranked table, which calculate_score --result-fd hands to
+// treasure_hub through a memfd: a header, then fixed-size records in rank
+// order. The child fills the file through a mapping and the hub renders the
+// report straight from its own mapping of the same pages, so scores are never
+// formatted, piped and re-read on the way.
+#define SCORE_RESULT_MAGIC "TSCR"
+
+typedef struct {
+    char magic[4];
+    uint32_t count;
+} ScoreResultHeader;
+
+typedef struct {
+    char user[MAX_NAME_LEN];
+    char padding[6];
+    int64_t total;
+} ScoreResult;
+
+// Sizes fd to hold the table and writes it there. Returns 0 or -1.
+int score_table_export(const ScoreTable *table, int fd);
+
+// Prints the report score_table_print would have for an exported table.
+// Returns 0, or -1 if fd does not hold a complete one.
+int score_result_print(const char *hunt_id, int fd, FILE *out);
+
+#endif
\ No newline at end of file
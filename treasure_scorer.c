@@ -0,0 +1,172 @@
+#define _GNU_SOURCE // memfd_create
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "treasure_scorer.h"
+
+static int start_worker(Scorer *worker) {
+    worker->pid = -1;
+    worker->sock = -1;
+    worker->result_fd = -1;
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) {
+        perror("socketpair");
+        return -1;
+    }
+    int memfd = memfd_create("scores", MFD_CLOEXEC);
+    if (memfd == -1) {
+        perror("memfd_create");
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(sv[0]);
+        close(sv[1]);
+        close(memfd);
+        return -1;
+    }
+
+    if (pid == 0) {
+        // dup2 and dup leave out the close-on-exec flag, so these survive the exec
+        dup2(sv[1], STDIN_FILENO);
+        char fd_arg[16];
+        snprintf(fd_arg, sizeof(fd_arg), "%d", dup(memfd));
+        execl("./calculate_score", "calculate_score", "--worker", "--result-fd", fd_arg, NULL);
+        perror("execl");
+        _exit(EXIT_FAILURE);
+    }
+
+    close(sv[1]);
+    worker->pid = pid;
+    worker->sock = sv[0];
+    worker->result_fd = memfd;
+    worker->last_used = time(NULL);
+    return 0;
+}
+
+// Closing the socket ends an idle worker; sig, when nonzero, ends a busy or
+// stuck one
+static void stop_worker(Scorer *worker, int sig) {
+    if (worker->sock != -1) {
+        close(worker->sock);
+    }
+    if (worker->pid > 0) {
+        if (sig) {
+            kill(worker->pid, sig);
+        }
+        while (waitpid(worker->pid, NULL, 0) == -1 && errno == EINTR) {
+        }
+    }
+    if (worker->result_fd != -1) {
+        close(worker->result_fd);
+    }
+    worker->pid = -1;
+    worker->sock = -1;
+    worker->result_fd = -1;
+}
+
+static int restart_worker(Scorer *worker) {
+    stop_worker(worker, SIGKILL);
+    return start_worker(worker);
+}
+
+// Sends one request without blocking on a worker that stopped reading
+static int send_request(Scorer *worker, const ScorerRequest *request) {
+    ssize_t bytes;
+    while ((bytes = send(worker->sock, request, sizeof(ScorerRequest), MSG_NOSIGNAL)) == -1 && errno == EINTR) {
+    }
+    return bytes == sizeof(ScorerRequest) ? 0 : -1;
+}
+
+// A worker passes if it is still running and, when it has been idle for a
+// while, answers a ping in time
+static int worker_healthy(Scorer *worker) {
+    if (worker->sock == -1 || waitpid(worker->pid, NULL, WNOHANG) != 0) {
+        return 0;
+    }
+    if (time(NULL) - worker->last_used < SCORER_PING_IDLE_SEC) {
+        return 1;
+    }
+
+    ScorerRequest ping;
+    memset(&ping, 0, sizeof(ping));
+    if (send_request(worker, &ping) == -1) {
+        return 0;
+    }
+    struct pollfd pfd = { worker->sock, POLLIN, 0 };
+    int ready;
+    while ((ready = poll(&pfd, 1, SCORER_PING_TIMEOUT_MS)) == -1 && errno == EINTR) {
+    }
+    ScorerReply reply;
+    if (ready != 1 || recv(worker->sock, &reply, sizeof(reply), 0) != sizeof(reply)) {
+        return 0;
+    }
+    worker->last_used = time(NULL);
+    return 1;
+}
+
+int scorer_pool_resize(ScorerPool *pool, size_t count) {
+    while (pool->count > count) {
+        stop_worker(&pool->workers[--pool->count], 0);
+    }
+    if (pool->count < count) {
+        Scorer *grown = realloc(pool->workers, count * sizeof(Scorer));
+        if (!grown) {
+            perror("realloc");
+            return pool->count > 0 ? 0 : -1;
+        }
+        pool->workers = grown;
+        while (pool->count < count && start_worker(&pool->workers[pool->count]) == 0) {
+            pool->count++;
+        }
+    }
+    return pool->count > 0 ? 0 : -1;
+}
+
+void scorer_pool_shutdown(ScorerPool *pool) {
+    scorer_pool_resize(pool, 0);
+    free(pool->workers);
+    pool->workers = NULL;
+}
+
+int scorer_submit(Scorer *worker, const char *hunt_id, int top) {
+    if (!worker_healthy(worker) && restart_worker(worker) == -1) {
+        return -1;
+    }
+
+    ScorerRequest request;
+    memset(&request, 0, sizeof(request));
+    request.top = top;
+    snprintf(request.hunt_id, sizeof(request.hunt_id), "%s", hunt_id);
+
+    // A worker can still die between the check and the send
+    if (send_request(worker, &request) == -1 && (restart_worker(worker) == -1 || send_request(worker, &request) == -1)) {
+        return -1;
+    }
+    return 0;
+}
+
+int scorer_collect(Scorer *worker) {
+    ScorerReply reply;
+    ssize_t bytes;
+    while ((bytes = recv(worker->sock, &reply, sizeof(reply), 0)) == -1 && errno == EINTR) {
+    }
+    worker->last_used = time(NULL);
+    if (bytes != sizeof(reply)) {
+        restart_worker(worker);
+        return -1;
+    }
+    return reply.status == 0 ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#ifndef TREASURE_SCORER_H
+#define TREASURE_SCORER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include "treasure.h"
+
+// Pool of resident ./calculate_score --worker processes that treasure_hub
+// scores hunts with, so a hunt costs one message round trip instead of a
+// fork and exec.
+//
+// Each worker is started once with a SOCK_SEQPACKET socketpair as its stdin
+// and a memfd of its own as its --result-fd. A request is one ScorerRequest
+// message; the worker exports the ranked table into its memfd (see
+// score_table_export) and answers with one ScorerReply, after which the hub
+// renders the report from the memfd. A request with an empty hunt ID is a
+// ping. Closing the socket tells the worker to exit.
+//
+// Before each request a worker is checked: one that has exited is replaced,
+// and one idle for SCORER_PING_IDLE_SEC must answer a ping within
+// SCORER_PING_TIMEOUT_MS or it is killed and replaced. A worker that dies
+// while scoring is replaced too, and the caller may resubmit the hunt.
+
+#define SCORER_PING_IDLE_SEC 5
+#define SCORER_PING_TIMEOUT_MS 1000
+
+typedef struct {
+    int32_t top; // leaders to keep, or 0 for all
+    char hunt_id[MAX_PATH_LEN];
+} ScorerRequest;
+
+typedef struct {
+    int32_t status; // 0, or -1 if the hunt could not be scored
+} ScorerReply;
+
+typedef struct {
+    pid_t pid;
+    int sock;      // hub's end of the socketpair, the worker's stdin
+    int result_fd; // memfd the worker exports each table into
+    time_t last_used;
+} Scorer;
+
+typedef struct {
+    Scorer *workers;
+    size_t count;
+} ScorerPool;
+
+// Starts or stops workers until the pool has count of them. Returns 0, or
+// -1 if none could be started.
+int scorer_pool_resize(ScorerPool *pool, size_t count);
+
+// Stops every worker and frees the pool
+void scorer_pool_shutdown(ScorerPool *pool);
+
+// Sends hunt_id to the worker once it passes its health check, replacing it
+// first if it does not. Returns 0 or -1.
+int scorer_submit(Scorer *worker, const char *hunt_id, int top);
+
+// Reads the worker's answer, once its sock is readable. Returns 0 with the
+// results in worker->result_fd, 1 if the hunt could not be scored, or -1 if
+// the worker died (it has been replaced by then).
+int scorer_collect(Scorer *worker);
+
+#endif
\ No newline at end of file
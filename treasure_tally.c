@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "treasure_tally.h"
+#include "treasure_map.h"
+
+#define TALLY_REMOVED UINT32_MAX
+#define LOG_CHUNK 65536
+#define WATCH_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM | \
+                      IN_DELETE_SELF | IN_MOVE_SELF)
+
+static void build_paths(const char *hunt_id, char *data_path, char *log_path) {
+    snprintf(data_path, MAX_PATH_LEN, "hunts/%s/treasures.dat", hunt_id);
+    snprintf(log_path, MAX_PATH_LEN, "hunts/%s/logged_hunt", hunt_id);
+}
+
+static size_t hash_offset(int64_t offset) {
+    uint64_t x = (uint64_t)offset * 0x9e3779b97f4a7c15ull;
+    return (size_t)(x ^ (x >> 29));
+}
+
+// Entries slots are empty when offset is -1
+static int grow_entries(HuntTally *hunt) {
+    size_t slot_count = hunt->entry_slots ? hunt->entry_slots * 2 : 1024;
+    TallyEntry *entries = malloc(slot_count * sizeof(TallyEntry));
+    if (!entries) {
+        return -1;
+    }
+    for (size_t i = 0; i < slot_count; i++) {
+        entries[i].offset = -1;
+    }
+
+    size_t mask = slot_count - 1;
+    for (size_t i = 0; i < hunt->entry_slots; i++) {
+        if (hunt->entries[i].offset == -1) {
+            continue;
+        }
+        size_t j = hash_offset(hunt->entries[i].offset) & mask;
+        while (entries[j].offset != -1) {
+            j = (j + 1) & mask;
+        }
+        entries[j] = hunt->entries[i];
+    }
+
+    free(hunt->entries);
+    hunt->entries = entries;
+    hunt->entry_slots = slot_count;
+    return 0;
+}
+
+static TallyEntry *find_entry(HuntTally *hunt, int64_t offset) {
+    if (hunt->entry_slots == 0) {
+        return NULL;
+    }
+    size_t mask = hunt->entry_slots - 1;
+    for (size_t i = hash_offset(offset) & mask; hunt->entries[i].offset != -1; i = (i + 1) & mask) {
+        if (hunt->entries[i].offset == offset) {
+            return &hunt->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static int count_record(HuntTally *hunt, const Treasure *treasure, int64_t offset) {
+    if ((hunt->entry_count + 1) * 2 > hunt->entry_slots && grow_entries(hunt) == -1) {
+        return -1;
+    }
+
+    long user = score_table_intern(&hunt->table, treasure->user);
+    if (user == -1) {
+        return -1;
+    }
+    if ((size_t)user >= hunt->live_capacity) {
+        size_t capacity = hunt->live_capacity ? hunt->live_capacity * 2 : 64;
+        size_t *live = realloc(hunt->live, capacity * sizeof(size_t));
+        if (!live) {
+            return -1;
+        }
+        memset(live + hunt->live_capacity, 0, (capacity - hunt->live_capacity) * sizeof(size_t));
+        hunt->live = live;
+        hunt->live_capacity = capacity;
+    }
+
+    size_t mask = hunt->entry_slots - 1;
+    size_t i = hash_offset(offset) & mask;
+    while (hunt->entries[i].offset != -1) {
+        if (hunt->entries[i].offset == offset) {
+            return 0; // already counted
+        }
+        i = (i + 1) & mask;
+    }
+    hunt->entries[i].offset = offset;
+    hunt->entries[i].user = user;
+    hunt->entries[i].value = treasure->value;
+    hunt->entry_count++;
+
+    hunt->table.users[user].total += treasure->value;
+    hunt->live[user]++;
+    return 0;
+}
+
+// Subtracts a removed record. Records that were never counted (already
+// tombstoned when scanned) are ignored, which makes replays harmless.
+static void uncount_record(HuntTally *hunt, int64_t offset) {
+    TallyEntry *entry = find_entry(hunt, offset);
+    if (!entry || entry->user == TALLY_REMOVED) {
+        return;
+    }
+    hunt->table.users[entry->user].total -= entry->value;
+    hunt->live[entry->user]--;
+    entry->user = TALLY_REMOVED;
+}
+
+static void reset_hunt(HuntTally *hunt) {
+    score_table_free(&hunt->table);
+    free(hunt->live);
+    free(hunt->entries);
+    hunt->live = NULL;
+    hunt->live_capacity = 0;
+    hunt->entries = NULL;
+    hunt->entry_count = 0;
+    hunt->entry_slots = 0;
+    hunt->scanned = 0;
+}
+
+// Folds in records appended since the last scan
+static int scan_appends(HuntTally *hunt) {
+    TreasureMap map;
+    if (treasure_map_open(hunt->hunt_id, &map) == -1) {
+        return -1;
+    }
+    if (hunt->scanned > map.position) {
+        map.position = hunt->scanned;
+    }
+
+    int ok = 1;
+    const Treasure *treasure;
+    off_t offset;
+    while (ok && (treasure = treasure_map_next(&map, &offset)) != NULL) {
+        if (treasure_is_live(treasure)) {
+            ok = count_record(hunt, treasure, offset) == 0;
+        }
+    }
+
+    // A torn record at the end is picked up once it is complete
+    hunt->scanned = map.position;
+    treasure_map_close(&map);
+    return ok ? 0 : -1;
+}
+
+// Applies REMOVE_TREASURE entries logged since the last call. Returns the
+// number applied, or -1 when an entry has no offset and a rescan is needed.
+static int apply_log(HuntTally *hunt, const char *log_path) {
+    int fd = open(log_path, O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+
+    int applied = 0;
+    char *buffer = malloc(LOG_CHUNK + 1);
+    ssize_t bytes;
+    while (buffer && (bytes = pread(fd, buffer, LOG_CHUNK, hunt->log_position)) > 0) {
+        buffer[bytes] = '\0';
+
+        // Only complete lines; a partial last line is read again next time
+        char *line = buffer;
+        char *newline;
+        while ((newline = strchr(line, '\n')) != NULL) {
+            *newline = '\0';
+            const char *remove = strstr(line, "] REMOVE_TREASURE ");
+            if (remove) {
+                const char *offset = strstr(remove, " offset=");
+                if (!offset) {
+                    applied = -1;
+                    break;
+                }
+                uncount_record(hunt, strtoll(offset + 8, NULL, 10));
+                applied++;
+            }
+            line = newline + 1;
+        }
+        if (applied == -1) {
+            break;
+        }
+
+        hunt->log_position += line - buffer;
+        if (line == buffer) {
+            break; // a line longer than the chunk; cannot happen with our logger
+        }
+    }
+
+    free(buffer);
+    close(fd);
+    return applied;
+}
+
+// Catches the hunt up with treasures.dat and its log
+static int refresh(HuntTally *hunt) {
+    char data_path[MAX_PATH_LEN];
+    char log_path[MAX_PATH_LEN];
+    build_paths(hunt->hunt_id, data_path, log_path);
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        struct stat st;
+        if (stat(data_path, &st) == -1) {
+            return -1;
+        }
+        struct stat log_st;
+        int have_log = stat(log_path, &log_st) == 0;
+
+        // Tombstones leave the size alone, so a change in mtime alone must be
+        // explained by the log; if it is not, start over
+        int rewritten = st.st_dev != hunt->device || st.st_ino != hunt->inode || st.st_size < hunt->scanned ||
+                        (have_log && (log_st.st_ino != hunt->log_inode || log_st.st_size < hunt->log_position));
+        int touched = st.st_mtim.tv_sec != hunt->mtime.tv_sec || st.st_mtim.tv_nsec != hunt->mtime.tv_nsec;
+        int grew = st.st_size > hunt->scanned;
+
+        if (rewritten || attempt > 0) {
+            // Start reading the log from its current end: earlier removals
+            // are already visible as tombstones to the scan that follows
+            reset_hunt(hunt);
+            hunt->device = st.st_dev;
+            hunt->inode = st.st_ino;
+            hunt->log_inode = have_log ? log_st.st_ino : 0;
+            hunt->log_position = have_log ? log_st.st_size : 0;
+            grew = 1;
+        }
+        hunt->mtime = st.st_mtim;
+
+        if (grew && scan_appends(hunt) == -1) {
+            return -1;
+        }
+
+        int applied = apply_log(hunt, log_path);
+        if (applied == -1 || (applied == 0 && touched && !grew && !rewritten && attempt == 0)) {
+            continue;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+static void drain_events(TallyState *state) {
+    if (state->inotify_fd == -1) {
+        return;
+    }
+
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while ((length = read(state->inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char *p = buffer; p < buffer + length;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->len > 0 && strcmp(event->name, "treasures.dat") != 0 &&
+                strcmp(event->name, "logged_hunt") != 0) {
+                continue;
+            }
+            for (HuntTally *hunt = state->hunts; hunt; hunt = hunt->next) {
+                if (hunt->watch == event->wd || (event->mask & IN_Q_OVERFLOW)) {
+                    hunt->dirty = 1;
+                }
+            }
+        }
+    }
+}
+
+int tally_init(TallyState *state) {
+    state->hunts = NULL;
+    state->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    pthread_mutex_init(&state->lock, NULL);
+    return 0;
+}
+
+int tally_scores(TallyState *state, const char *hunt_id, ScoreTable *out) {
+    memset(out, 0, sizeof(ScoreTable));
+    pthread_mutex_lock(&state->lock);
+    drain_events(state);
+
+    HuntTally *hunt = state->hunts;
+    while (hunt && strcmp(hunt->hunt_id, hunt_id) != 0) {
+        hunt = hunt->next;
+    }
+
+    if (!hunt) {
+        hunt = calloc(1, sizeof(HuntTally));
+        if (!hunt) {
+            pthread_mutex_unlock(&state->lock);
+            return -1;
+        }
+        snprintf(hunt->hunt_id, MAX_PATH_LEN, "%s", hunt_id);
+        hunt->dirty = 1;
+        hunt->watch = -1;
+        pthread_mutex_init(&hunt->lock, NULL);
+
+        // Watch before the first scan so no change falls in between
+        char dir_path[MAX_PATH_LEN];
+        snprintf(dir_path, MAX_PATH_LEN, "hunts/%s", hunt_id);
+        if (state->inotify_fd != -1) {
+            hunt->watch = inotify_add_watch(state->inotify_fd, dir_path, WATCH_EVENTS);
+        }
+        hunt->next = state->hunts;
+        state->hunts = hunt;
+    }
+
+    // Taking the hunt's lock before releasing the list makes a concurrent
+    // query wait for this refresh rather than see the flag already cleared
+    pthread_mutex_lock(&hunt->lock);
+    int dirty = hunt->dirty || hunt->watch == -1;
+    hunt->dirty = 0;
+    pthread_mutex_unlock(&state->lock);
+
+    if (dirty && refresh(hunt) == -1) {
+        pthread_mutex_unlock(&hunt->lock);
+        pthread_mutex_lock(&state->lock);
+        hunt->dirty = 1;
+        pthread_mutex_unlock(&state->lock);
+        return -1;
+    }
+
+    for (size_t u = 0; u < hunt->table.count; u++) {
+        if (hunt->live[u] == 0) {
+            continue;
+        }
+        if (out->count == out->capacity) {
+            size_t capacity = out->capacity ? out->capacity * 2 : 64;
+            UserScore *users = realloc(out->users, capacity * sizeof(UserScore));
+            if (!users) {
+                pthread_mutex_unlock(&hunt->lock);
+                score_table_free(out);
+                return -1;
+            }
+            out->users = users;
+            out->capacity = capacity;
+        }
+        out->users[out->count++] = hunt->table.users[u];
+    }
+    pthread_mutex_unlock(&hunt->lock);
+    return 0;
+}
+
+void tally_free(TallyState *state) {
+    while (state->hunts) {
+        HuntTally *hunt = state->hunts;
+        state->hunts = hunt->next;
+        reset_hunt(hunt);
+        pthread_mutex_destroy(&hunt->lock);
+        free(hunt);
+    }
+    if (state->inotify_fd != -1) {
+        close(state->inotify_fd);
+    }
+    state->inotify_fd = -1;
+    pthread_mutex_destroy(&state->lock);
+}
\ No newline at end of file
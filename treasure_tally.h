@@ -0,0 +1,67 @@
+#ifndef TREASURE_TALLY_H
+#define TREASURE_TALLY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include "treasure.h"
+#include "treasure_score.h"
+
+// Running per-user score totals kept by the monitor, so scores are answered
+// without rescanning treasures.dat.
+//
+// Each hunt remembers how far into treasures.dat and its log it has read.
+// Appended records are folded in from the previous end of the file, and
+// REMOVE_TREASURE log entries (which carry the record's offset) subtract the
+// removed record. A replaced or truncated file, such as after compaction,
+// starts the hunt over with a full scan. inotify watches on hunts/<id>/ mark
+// hunts dirty, so an unchanged hunt is answered from memory alone; without
+// inotify each query checks the files' sizes instead.
+//
+// The state is shared by the monitor's worker threads. Each hunt has its own
+// lock, so a hunt being rescanned only holds up queries for that hunt.
+
+typedef struct {
+    int64_t offset;
+    uint32_t user; // position in the table, TALLY_REMOVED once subtracted
+    int32_t value;
+} TallyEntry;
+
+typedef struct HuntTally {
+    char hunt_id[MAX_PATH_LEN];
+    ScoreTable table;     // totals; positions never move
+    size_t *live;         // counted records per user, parallel to table.users
+    size_t live_capacity;
+    TallyEntry *entries;  // counted records by offset, open addressing
+    size_t entry_count;
+    size_t entry_slots;
+    dev_t device;
+    ino_t inode;
+    off_t scanned;        // bytes of treasures.dat folded in
+    struct timespec mtime;
+    ino_t log_inode;
+    off_t log_position;   // bytes of the log already applied
+    int watch;
+    int dirty;            // guarded by the state's lock
+    pthread_mutex_t lock; // guards everything else
+    struct HuntTally *next;
+} HuntTally;
+
+typedef struct {
+    HuntTally *hunts;
+    int inotify_fd;
+    pthread_mutex_t lock; // guards the list, the watches and dirty flags
+} TallyState;
+
+int tally_init(TallyState *state);
+
+// Brings the hunt's totals up to date and stores a copy of the users that
+// still have treasures in *out, ready for score_table_rank. Returns 0, or -1
+// if the hunt cannot be read.
+int tally_scores(TallyState *state, const char *hunt_id, ScoreTable *out);
+
+void tally_free(TallyState *state);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,437 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "treasure_users.h"
+#include "treasure_map.h"
+#include "treasure_index.h"
+
+#define BUILD_CHUNK 65536 // records grouped by user at a time when scanning a hunt
+
+// A reference to write or clear, before references are grouped by user
+typedef struct {
+    char user[MAX_NAME_LEN];
+    char treasure_id[MAX_ID_LEN];
+    off_t offset;
+} PendingRef;
+
+// dir/<hex of user>: names may hold any byte but '\0'
+static void user_path(const char *dir, const char *user, char *path) {
+    static const char digits[] = "0123456789abcdef";
+    int length = snprintf(path, MAX_PATH_LEN, "%s/", dir);
+    for (size_t i = 0; i < MAX_NAME_LEN && user[i] && length + 2 < MAX_PATH_LEN; i++) {
+        path[length++] = digits[(unsigned char)user[i] >> 4];
+        path[length++] = digits[(unsigned char)user[i] & 0xf];
+    }
+    path[length] = '\0';
+}
+
+static void set_pending(PendingRef *pending, const Treasure *treasure, off_t offset) {
+    memcpy(pending->user, treasure->user, MAX_NAME_LEN);
+    pending->user[MAX_NAME_LEN - 1] = '\0';
+    memcpy(pending->treasure_id, treasure->id, MAX_ID_LEN);
+    pending->treasure_id[MAX_ID_LEN - 1] = '\0';
+    pending->offset = offset;
+}
+
+static int compare_pending(const void *a, const void *b) {
+    return strcmp(((const PendingRef *)a)->user, ((const PendingRef *)b)->user);
+}
+
+// Reads a user's whole file; a slot torn by a crash at the end is left out,
+// and the next append overwrites it
+static int read_refs(int fd, UserRef **refs, size_t *count) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        return -1;
+    }
+    *count = st.st_size / sizeof(UserRef);
+    *refs = malloc((*count ? *count : 1) * sizeof(UserRef));
+    if (!*refs) {
+        return -1;
+    }
+    size_t length = *count * sizeof(UserRef);
+    if (length > 0 && pread(fd, *refs, length, 0) != (ssize_t)length) {
+        free(*refs);
+        return -1;
+    }
+    return 0;
+}
+
+// Writes references to count treasures of one user, filling cleared slots
+// before appending
+static int write_group(const char *dir, const char *hunt_id, const PendingRef *pending, size_t count) {
+    char path[MAX_PATH_LEN];
+    user_path(dir, pending[0].user, path);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd == -1) {
+        return -1;
+    }
+
+    UserRef *existing;
+    size_t existing_count;
+    if (flock(fd, LOCK_EX) == -1 || read_refs(fd, &existing, &existing_count) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    UserRef *refs = calloc(count, sizeof(UserRef));
+    int ok = refs != NULL;
+    for (size_t i = 0; ok && i < count; i++) {
+        refs[i].live = 1;
+        memcpy(refs[i].hunt_id, hunt_id, strlen(hunt_id) + 1);
+        memcpy(refs[i].treasure_id, pending[i].treasure_id, MAX_ID_LEN);
+        refs[i].offset = pending[i].offset;
+    }
+
+    size_t next = 0;
+    for (size_t slot = 0; ok && slot < existing_count && next < count; slot++) {
+        if (!existing[slot].live) {
+            ok = pwrite(fd, &refs[next++], sizeof(UserRef), slot * sizeof(UserRef)) == sizeof(UserRef);
+        }
+    }
+    if (ok && next < count) {
+        size_t length = (count - next) * sizeof(UserRef);
+        ok = pwrite(fd, &refs[next], length, existing_count * sizeof(UserRef)) == (ssize_t)length;
+    }
+
+    free(refs);
+    free(existing);
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+// Sorts references by user and writes each user's with one pass over their file
+static int write_pending(const char *dir, const char *hunt_id, PendingRef *pending, size_t count) {
+    qsort(pending, count, sizeof(PendingRef), compare_pending);
+    for (size_t i = 0, end; i < count; i = end) {
+        for (end = i + 1; end < count && strcmp(pending[end].user, pending[i].user) == 0; end++) {
+        }
+        if (write_group(dir, hunt_id, pending + i, end - i) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Clears the user's references into the hunt: the one to treasure_id, or
+// all of them when treasure_id is NULL
+static int clear_refs(const char *user, const char *hunt_id, const char *treasure_id) {
+    char path[MAX_PATH_LEN];
+    user_path(USER_INDEX_DIR, user, path);
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd == -1) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    UserRef *refs;
+    size_t count;
+    if (flock(fd, LOCK_EX) == -1 || read_refs(fd, &refs, &count) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    int ok = 1;
+    uint8_t cleared = 0;
+    for (size_t i = 0; ok && i < count; i++) {
+        if (!refs[i].live || strncmp(refs[i].hunt_id, hunt_id, USER_REF_HUNT_LEN) != 0 ||
+            (treasure_id && strncmp(refs[i].treasure_id, treasure_id, MAX_ID_LEN) != 0)) {
+            continue;
+        }
+        ok = pwrite(fd, &cleared, 1, i * sizeof(UserRef) + offsetof(UserRef, live)) == 1;
+        if (treasure_id) {
+            break;
+        }
+    }
+
+    free(refs);
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+// Indexes every live treasure of the hunt into dir
+static int index_hunt(const char *dir, const char *hunt_id) {
+    TreasureMap map;
+    if (treasure_map_open(hunt_id, &map) == -1) {
+        return 0; // a hunt whose first add is still running; that add indexes itself
+    }
+
+    PendingRef *chunk = malloc(BUILD_CHUNK * sizeof(PendingRef));
+    int ok = chunk != NULL;
+    size_t count = 0;
+    const Treasure *treasure;
+    off_t offset;
+    while (ok && (treasure = treasure_map_next(&map, &offset)) != NULL) {
+        if (!treasure_is_live(treasure)) {
+            continue;
+        }
+        set_pending(&chunk[count++], treasure, offset);
+        if (count == BUILD_CHUNK) {
+            ok = write_pending(dir, hunt_id, chunk, count) == 0;
+            count = 0;
+        }
+    }
+    if (ok && count > 0) {
+        ok = write_pending(dir, hunt_id, chunk, count) == 0;
+    }
+
+    free(chunk);
+    treasure_map_close(&map);
+    return ok ? 0 : -1;
+}
+
+static void remove_dir(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                char file_path[MAX_PATH_LEN];
+                snprintf(file_path, MAX_PATH_LEN, "%s/%s", path, entry->d_name);
+                unlink(file_path);
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+// Builds the index from every hunt in a directory of its own, then moves it
+// into place unless another build finished first
+static int build_index() {
+    char temp_dir[MAX_PATH_LEN];
+    snprintf(temp_dir, MAX_PATH_LEN, "%s.XXXXXX", USER_INDEX_DIR);
+    if (!mkdtemp(temp_dir)) {
+        return -1;
+    }
+    chmod(temp_dir, 0755);
+
+    DIR *dir = opendir("hunts");
+    int ok = dir != NULL;
+    struct dirent *entry;
+    while (ok && (entry = readdir(dir)) != NULL) {
+        // Hunts are the directories; the catalog and dot entries are not
+        if (entry->d_name[0] == '.' || (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN) ||
+            strlen(entry->d_name) >= USER_REF_HUNT_LEN) {
+            continue;
+        }
+        ok = index_hunt(temp_dir, entry->d_name) == 0;
+    }
+    if (dir) {
+        closedir(dir);
+    }
+
+    // Never empty, as rename would replace an empty index that is in use
+    char marker[MAX_PATH_LEN];
+    snprintf(marker, MAX_PATH_LEN, "%s/.built", temp_dir);
+    int fd = ok ? open(marker, O_WRONLY | O_CREAT | O_CLOEXEC, 0666) : -1;
+    if (fd != -1) {
+        close(fd);
+        if (rename(temp_dir, USER_INDEX_DIR) == 0) {
+            return 0;
+        }
+        ok = errno == EEXIST || errno == ENOTEMPTY;
+    }
+    remove_dir(temp_dir);
+    return ok ? 0 : -1;
+}
+
+static int ensure_index() {
+    if (access(USER_INDEX_DIR, F_OK) == 0) {
+        return 0;
+    }
+    return errno == ENOENT ? build_index() : -1;
+}
+
+int user_index_add(const char *hunt_id, const Treasure *records, const off_t *offsets, size_t count) {
+    if (strlen(hunt_id) >= USER_REF_HUNT_LEN || count == 0) {
+        return 0;
+    }
+    if (ensure_index() == -1) {
+        return -1;
+    }
+
+    PendingRef *pending = malloc(count * sizeof(PendingRef));
+    if (!pending) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        set_pending(&pending[i], &records[i], offsets[i]);
+    }
+    int result = write_pending(USER_INDEX_DIR, hunt_id, pending, count);
+    free(pending);
+    return result;
+}
+
+int user_index_remove(const char *user, const char *hunt_id, const char *treasure_id) {
+    if (strlen(hunt_id) >= USER_REF_HUNT_LEN) {
+        return 0;
+    }
+    // An index built from here on already leaves the removed record out
+    if (ensure_index() == -1) {
+        return -1;
+    }
+    return clear_refs(user, hunt_id, treasure_id);
+}
+
+int user_index_drop_hunt(const char *hunt_id) {
+    if (strlen(hunt_id) >= USER_REF_HUNT_LEN || access(USER_INDEX_DIR, F_OK) == -1) {
+        return 0; // nothing indexed, and a later build will not find the hunt
+    }
+
+    TreasureMap map;
+    if (treasure_map_open(hunt_id, &map) == -1) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    // Each of the hunt's owners once per chunk of records
+    PendingRef *chunk = malloc(BUILD_CHUNK * sizeof(PendingRef));
+    int ok = chunk != NULL;
+    int done = 0;
+    while (ok && !done) {
+        size_t count = 0;
+        const Treasure *treasure;
+        while (count < BUILD_CHUNK && (treasure = treasure_map_next(&map, NULL)) != NULL) {
+            if (treasure_is_live(treasure)) {
+                set_pending(&chunk[count++], treasure, 0);
+            }
+        }
+        done = count < BUILD_CHUNK;
+
+        qsort(chunk, count, sizeof(PendingRef), compare_pending);
+        for (size_t i = 0; ok && i < count; i++) {
+            if (i == 0 || strcmp(chunk[i].user, chunk[i - 1].user) != 0) {
+                ok = clear_refs(chunk[i].user, hunt_id, NULL) == 0;
+            }
+        }
+    }
+
+    free(chunk);
+    treasure_map_close(&map);
+    return ok ? 0 : -1;
+}
+
+static int compare_refs(const void *a, const void *b) {
+    const UserRef *x = a;
+    const UserRef *y = b;
+    int order = strncmp(x->hunt_id, y->hunt_id, USER_REF_HUNT_LEN);
+    if (!order) {
+        order = strncmp(x->treasure_id, y->treasure_id, MAX_ID_LEN);
+    }
+    return order ? order : (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+static int same_treasure_id(const UserRef *a, const UserRef *b) {
+    return strncmp(a->hunt_id, b->hunt_id, USER_REF_HUNT_LEN) == 0 &&
+           strncmp(a->treasure_id, b->treasure_id, MAX_ID_LEN) == 0;
+}
+
+static int ref_matches(const Treasure *treasure, const UserRef *ref, const char *user) {
+    return treasure && treasure_is_live(treasure) && strncmp(treasure->id, ref->treasure_id, MAX_ID_LEN) == 0 &&
+           strncmp(treasure->user, user, MAX_NAME_LEN) == 0;
+}
+
+// Visits the user's live records behind a run of references to one treasure
+// ID, sorted by offset. IDs may repeat, so the same ID at distinct offsets is
+// distinct records; the same offset twice was written again after a failed
+// add. When an offset went stale and the ID index cannot resolve it, because
+// the user holds the ID more than once or another record holds it first, the
+// hunt is scanned for every record of the user's with that ID. Returns the
+// number visited.
+static long visit_run(TreasureMap *map, const UserRef *refs, size_t count, const char *user,
+                      UserTreasureVisitor visit, void *arg) {
+    int stale = 0;
+    for (size_t k = 0; k < count && !stale; k++) {
+        stale = !ref_matches(treasure_map_at(map, refs[k].offset), &refs[k], user);
+    }
+
+    long found = 0;
+    const Treasure *treasure;
+    if (!stale) {
+        for (size_t k = 0; k < count; k++) {
+            if (k == 0 || refs[k].offset != refs[k - 1].offset) {
+                visit(refs[k].hunt_id, treasure_map_at(map, refs[k].offset), arg);
+                found++;
+            }
+        }
+        return found;
+    }
+
+    // The ID index finds the first record holding the ID, which is the
+    // user's unless the hunt repeats IDs
+    int single = refs[count - 1].offset == refs[0].offset;
+    if (single) {
+        treasure = index_find(refs[0].hunt_id, map, refs[0].treasure_id, NULL);
+        if (ref_matches(treasure, &refs[0], user)) {
+            visit(refs[0].hunt_id, treasure, arg);
+            return 1;
+        }
+    }
+    if (!single || index_has_duplicates(refs[0].hunt_id) != 0) {
+        map->position = treasure_file_data_start(map->format);
+        while ((treasure = treasure_map_next(map, NULL)) != NULL) {
+            if (ref_matches(treasure, &refs[0], user)) {
+                visit(refs[0].hunt_id, treasure, arg);
+                found++;
+            }
+        }
+    }
+    return found;
+}
+
+long user_index_find(const char *user, UserTreasureVisitor visit, void *arg) {
+    if (ensure_index() == -1) {
+        return -1;
+    }
+
+    char path[MAX_PATH_LEN];
+    user_path(USER_INDEX_DIR, user, path);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    UserRef *refs;
+    size_t count;
+    if (flock(fd, LOCK_SH) == -1 || read_refs(fd, &refs, &count) == -1) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    size_t live = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (refs[i].live) {
+            refs[live] = refs[i];
+            refs[live].hunt_id[USER_REF_HUNT_LEN - 1] = '\0';
+            live++;
+        }
+    }
+    qsort(refs, live, sizeof(UserRef), compare_refs);
+
+    // One mapping per hunt; a reference whose offset went stale is looked up
+    // by ID, and one whose record is gone or no longer the user's is skipped
+    long found = 0;
+    for (size_t i = 0, end; i < live; i = end) {
+        for (end = i + 1; end < live && strcmp(refs[end].hunt_id, refs[i].hunt_id) == 0; end++) {
+        }
+
+        TreasureMap map;
+        if (treasure_map_open(refs[i].hunt_id, &map) == -1) {
+            continue;
+        }
+        for (size_t k = i, run_end; k < end; k = run_end) {
+            for (run_end = k + 1; run_end < end && same_treasure_id(&refs[run_end], &refs[k]); run_end++) {
+            }
+            found += visit_run(&map, refs + k, run_end - k, user, visit, arg);
+        }
+        treasure_map_close(&map);
+    }
+
+    free(refs);
+    return found;
+}
\ No newline at end of file
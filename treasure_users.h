@@ -0,0 +1,61 @@
+#ifndef TREASURE_USERS_H
+#define TREASURE_USERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "treasure.h"
+
+// Index of every hunt by treasure owner (hunts/.users), so finding a user's
+// treasures reads that user's references instead of every treasures.dat.
+//
+// Each user has a file named after the hex encoding of their name, holding
+// fixed-size references (hunt ID, treasure ID, offset) to their treasures.
+// Writers update it under flock, after planning a change and while holding
+// the hunt's lock: a reference is written before its add is committed and
+// cleared after its removal is, and a removed reference's slot is reused by
+// the user's next add. The index therefore never misses a treasure, but a
+// crash or failed commit can leave references to records that do not exist.
+// Lookups check every reference against the record it points to and skip
+// those that no longer match, so no replay is needed.
+//
+// Offsets are hints that go stale when a hunt is compacted; a reference
+// whose offset no longer holds its treasure is found through the hunt's ID
+// index instead, or by scanning the hunt when the user holds that ID more
+// than once there, since IDs need not be unique.
+//
+// The directory is built from every hunt by whoever first needs it and moved
+// into place whole. Hunt IDs of USER_REF_HUNT_LEN bytes or more are not
+// indexed.
+
+#define USER_INDEX_DIR "hunts/.users"
+#define USER_REF_HUNT_LEN 256
+
+typedef struct {
+    uint8_t live;
+    char hunt_id[USER_REF_HUNT_LEN];
+    char treasure_id[MAX_ID_LEN];
+    char padding[3];
+    int64_t offset; // where the record was when the reference was written
+} UserRef;
+
+// Records count treasures about to be appended to the hunt at offsets.
+// Returns 0, or -1 if any reference could not be written, in which case the
+// records must not be committed.
+int user_index_add(const char *hunt_id, const Treasure *records, const off_t *offsets, size_t count);
+
+// Clears the reference to a treasure of user's that was removed. Returns 0,
+// or -1 on error.
+int user_index_remove(const char *user, const char *hunt_id, const char *treasure_id);
+
+// Clears the references to every treasure of a hunt that is being removed,
+// before its treasures.dat goes. Returns 0 or -1.
+int user_index_drop_hunt(const char *hunt_id);
+
+// Calls visit for each live treasure user owns, grouped by hunt. The record
+// is only valid during the call. Returns the number of treasures visited,
+// or -1 on error.
+typedef void (*UserTreasureVisitor)(const char *hunt_id, const Treasure *treasure, void *arg);
+long user_index_find(const char *user, UserTreasureVisitor visit, void *arg);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "treasure_wal.h"
+
+#define WAL_MAGIC "TWAL"
+#define WAL_VERSION 1
+#define BOOT_ID_LEN 40
+#define MAX_GROUP_LEN (1u << 30)
+
+// On-disk header, followed by groups
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t applied;           // journal bytes whose writes reached treasures.dat
+    char boot_id[BOOT_ID_LEN];  // boot in which `applied` was written
+} WalHeader;
+
+// A group: this header, then `count` chunks of a WalChunk and its data
+typedef struct {
+    uint32_t crc;    // CRC-32 of everything after this field
+    uint32_t length; // bytes after this header
+    uint32_t type;
+    uint32_t count;
+} WalGroup;
+
+typedef struct {
+    uint64_t offset;
+    uint32_t length;
+    uint32_t reserved;
+} WalChunk;
+
+struct Wal {
+    char hunt_id[MAX_PATH_LEN];
+    int fd;
+    off_t size;
+    WalHeader header;
+    int checkpoint_due; // replayed on a new boot, so marking means syncing
+};
+
+static uint32_t crc_update(uint32_t crc, const void *data, size_t length) {
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+    }
+
+    const unsigned char *p = data;
+    crc = ~crc;
+    while (length--) {
+        crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint32_t group_crc(const WalGroup *group, const char *payload) {
+    uint32_t crc = crc_update(0, &group->length, sizeof(WalGroup) - sizeof(group->crc));
+    return crc_update(crc, payload, group->length);
+}
+
+static void wal_path(const char *hunt_id, char *path) {
+    snprintf(path, MAX_PATH_LEN, "hunts/%s/treasures.wal", hunt_id);
+}
+
+// Identifies the running boot; empty when unknown, which never matches
+static void current_boot(char *boot_id) {
+    memset(boot_id, 0, BOOT_ID_LEN);
+    FILE *file = fopen("/proc/sys/kernel/random/boot_id", "r");
+    if (file) {
+        if (fgets(boot_id, BOOT_ID_LEN, file)) {
+            boot_id[strcspn(boot_id, "\n")] = '\0';
+        }
+        fclose(file);
+    }
+}
+
+static int same_boot(const WalHeader *header) {
+    char boot_id[BOOT_ID_LEN];
+    current_boot(boot_id);
+    return boot_id[0] != '\0' && strncmp(boot_id, header->boot_id, BOOT_ID_LEN) == 0;
+}
+
+static int write_at(int fd, const void *data, size_t length, off_t offset) {
+    const char *p = data;
+    while (length > 0) {
+        ssize_t bytes = pwrite(fd, p, length, offset);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += bytes;
+        length -= bytes;
+        offset += bytes;
+    }
+    return 0;
+}
+
+static int mark_applied(Wal *wal) {
+    wal->header.applied = wal->size;
+    current_boot(wal->header.boot_id);
+    return write_at(wal->fd, &wal->header, sizeof(WalHeader), 0);
+}
+
+// Reads the group at offset into *payload (malloc'd). Returns the group's
+// total size, or 0 at the end of the journal or a torn or corrupt group.
+static size_t read_group(int fd, off_t offset, off_t size, WalGroup *group, char **payload) {
+    if (size - offset < (off_t)sizeof(WalGroup) ||
+        pread(fd, group, sizeof(WalGroup), offset) != sizeof(WalGroup) ||
+        group->length > MAX_GROUP_LEN || size - offset - (off_t)sizeof(WalGroup) < (off_t)group->length) {
+        return 0;
+    }
+
+    *payload = malloc(group->length ? group->length : 1);
+    if (!*payload) {
+        return 0;
+    }
+    if (pread(fd, *payload, group->length, offset + sizeof(WalGroup)) != (ssize_t)group->length ||
+        group_crc(group, *payload) != group->crc) {
+        free(*payload);
+        return 0;
+    }
+    return sizeof(WalGroup) + group->length;
+}
+
+// Turns a group's payload back into writes pointing into it. Returns the
+// number of writes, or -1 if the chunks do not add up.
+static ssize_t decode_group(const WalGroup *group, char *payload, TreasureWrite **writes) {
+    *writes = malloc((group->count ? group->count : 1) * sizeof(TreasureWrite));
+    if (!*writes) {
+        return -1;
+    }
+
+    size_t used = 0;
+    for (uint32_t i = 0; i < group->count; i++) {
+        WalChunk chunk;
+        if (group->length - used < sizeof(WalChunk)) {
+            free(*writes);
+            return -1;
+        }
+        memcpy(&chunk, payload + used, sizeof(WalChunk));
+        used += sizeof(WalChunk);
+        if (group->length - used < chunk.length) {
+            free(*writes);
+            return -1;
+        }
+        (*writes)[i].offset = chunk.offset;
+        (*writes)[i].data = payload + used;
+        (*writes)[i].length = chunk.length;
+        used += chunk.length;
+    }
+    return group->count;
+}
+
+// Applies every complete group from `from` on and drops a torn tail
+static int replay(Wal *wal, off_t from, size_t *replayed) {
+    off_t offset = from;
+    while (1) {
+        WalGroup group;
+        char *payload;
+        size_t length = read_group(wal->fd, offset, wal->size, &group, &payload);
+        if (length == 0) {
+            break;
+        }
+
+        TreasureWrite *writes;
+        ssize_t count = decode_group(&group, payload, &writes);
+        int ok = count >= 0 && treasure_file_apply(wal->hunt_id, writes, count) == 0;
+        if (count >= 0) {
+            free(writes);
+        }
+        free(payload);
+        if (!ok) {
+            return -1;
+        }
+        offset += length;
+        (*replayed)++;
+    }
+
+    if (offset < wal->size) {
+        if (ftruncate(wal->fd, offset) == -1) {
+            return -1;
+        }
+        wal->size = offset;
+    }
+    return 0;
+}
+
+static int reset_journal(Wal *wal) {
+    memset(&wal->header, 0, sizeof(WalHeader));
+    memcpy(wal->header.magic, WAL_MAGIC, 4);
+    wal->header.version = WAL_VERSION;
+    wal->size = sizeof(WalHeader);
+    if (ftruncate(wal->fd, sizeof(WalHeader)) == -1 || mark_applied(wal) == -1) {
+        return -1;
+    }
+    return fdatasync(wal->fd);
+}
+
+static int read_header(int fd, off_t size, WalHeader *header) {
+    return size >= (off_t)sizeof(WalHeader) && pread(fd, header, sizeof(WalHeader), 0) == sizeof(WalHeader) &&
+           memcmp(header->magic, WAL_MAGIC, 4) == 0 && header->version == WAL_VERSION &&
+           header->applied >= sizeof(WalHeader) && header->applied <= (uint64_t)size;
+}
+
+Wal *wal_open(const char *hunt_id, size_t *replayed) {
+    *replayed = 0;
+    Wal *wal = calloc(1, sizeof(Wal));
+    if (!wal) {
+        return NULL;
+    }
+    snprintf(wal->hunt_id, MAX_PATH_LEN, "%s", hunt_id);
+
+    char path[MAX_PATH_LEN];
+    wal_path(hunt_id, path);
+    wal->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    struct stat st;
+    if (wal->fd == -1 || fstat(wal->fd, &st) == -1) {
+        if (wal->fd != -1) {
+            close(wal->fd);
+        }
+        free(wal);
+        return NULL;
+    }
+    wal->size = st.st_size;
+
+    int ok;
+    if (!read_header(wal->fd, wal->size, &wal->header)) {
+        // New journal, or a header lost before anything was committed
+        ok = reset_journal(wal) == 0;
+    } else if (same_boot(&wal->header)) {
+        // The page cache survived: everything up to the mark is in place
+        ok = replay(wal, wal->header.applied, replayed) == 0;
+    } else {
+        // Unsynced data writes may be gone; redo them all and make them stick
+        wal->checkpoint_due = 1;
+        ok = replay(wal, sizeof(WalHeader), replayed) == 0 && (*replayed > 0 || wal_checkpoint(wal) == 0);
+    }
+
+    if (!ok) {
+        close(wal->fd);
+        free(wal);
+        return NULL;
+    }
+    return wal;
+}
+
+int wal_commit(Wal *wal, uint32_t type, const TreasureWrite *writes, size_t count) {
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++) {
+        length += sizeof(WalChunk) + writes[i].length;
+    }
+    if (length > MAX_GROUP_LEN) {
+        errno = EFBIG;
+        return -1;
+    }
+
+    char *buffer = malloc(sizeof(WalGroup) + length);
+    if (!buffer) {
+        return -1;
+    }
+    WalGroup group = { 0, length, type, count };
+    char *p = buffer + sizeof(WalGroup);
+    for (size_t i = 0; i < count; i++) {
+        WalChunk chunk = { writes[i].offset, writes[i].length, 0 };
+        memcpy(p, &chunk, sizeof(WalChunk));
+        memcpy(p + sizeof(WalChunk), writes[i].data, writes[i].length);
+        p += sizeof(WalChunk) + writes[i].length;
+    }
+    group.crc = group_crc(&group, buffer + sizeof(WalGroup));
+    memcpy(buffer, &group, sizeof(WalGroup));
+
+    // The group is committed once the sync returns
+    int ok = write_at(wal->fd, buffer, sizeof(WalGroup) + length, wal->size) == 0 && fdatasync(wal->fd) == 0;
+    free(buffer);
+    if (!ok) {
+        return -1; // the next group overwrites whatever part of this one got out
+    }
+    wal->size += sizeof(WalGroup) + length;
+    return 0;
+}
+
+int wal_apply(Wal *wal, const TreasureWrite *writes, size_t count) {
+    return treasure_file_apply(wal->hunt_id, writes, count);
+}
+
+int wal_mark_applied(Wal *wal) {
+    if (wal->checkpoint_due) {
+        return wal_checkpoint(wal);
+    }
+    return mark_applied(wal);
+}
+
+int wal_checkpoint(Wal *wal) {
+    char path[MAX_PATH_LEN];
+    snprintf(path, MAX_PATH_LEN, "hunts/%s/treasures.dat", wal->hunt_id);
+    int fd = open(path, O_RDONLY);
+    if (fd == -1 && errno != ENOENT) {
+        return -1;
+    }
+    if (fd != -1) {
+        int synced = fdatasync(fd);
+        close(fd);
+        if (synced == -1) {
+            return -1;
+        }
+    }
+
+    // Emptied durably, so old groups can never be replayed onto a file that
+    // compaction has since replaced
+    wal->checkpoint_due = 0;
+    return reset_journal(wal);
+}
+
+void wal_close(Wal *wal) {
+    double kilobytes = DEFAULT_CHECKPOINT_KB;
+    const char *setting = getenv("TREASURE_WAL_CHECKPOINT_KB");
+    if (setting) {
+        kilobytes = atof(setting);
+    }
+    if (wal->size - (off_t)sizeof(WalHeader) > kilobytes * 1024) {
+        wal_checkpoint(wal);
+    }
+
+    close(wal->fd);
+    free(wal);
+}
+
+int wal_pending(const char *hunt_id) {
+    char path[MAX_PATH_LEN];
+    wal_path(hunt_id, path);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return 0;
+    }
+
+    struct stat st;
+    WalHeader header;
+    int pending = fstat(fd, &st) == 0 && read_header(fd, st.st_size, &header) &&
+                  (same_boot(&header) ? header.applied < (uint64_t)st.st_size
+                                      : st.st_size > (off_t)sizeof(WalHeader));
+    close(fd);
+    return pending;
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#ifndef TREASURE_WAL_H
+#define TREASURE_WAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "treasure_file.h"
+
+// Write-ahead journal for treasures.dat (hunts/<id>/treasures.wal).
+//
+// Every mutation is planned as the exact writes it makes to treasures.dat
+// (treasure_file_plan_*). One command's writes, however many records a batch
+// holds, go into the journal as a single checksummed group and are made
+// durable with one fdatasync; only then are they applied to treasures.dat,
+// which is not synced per write. Groups are physical writes at fixed
+// offsets, so replaying one that was already applied is harmless.
+//
+// A group is marked applied only after the caller has brought the hunt's
+// sidecars (index, columns, spatial index, catalog) up to date with it, so a
+// crash before then replays it and the sidecars are rebuilt.
+//
+// The journal header marks how much has been applied and in which boot.
+// After a process crash only groups past the mark are replayed; after a
+// system crash (another boot ID, so unsynced data writes may be lost) all of
+// them are. A group torn by a crash fails its CRC-32 and is dropped whole;
+// it was never acknowledged.
+//
+// A checkpoint syncs treasures.dat and empties the journal. It runs once the
+// journal passes TREASURE_WAL_CHECKPOINT_KB (default 4096), after replaying
+// on a new boot, and before compaction replaces the file.
+//
+// All calls need the hunt's exclusive lock (treasure_lock.h).
+
+#define WAL_ADD 1
+#define WAL_REMOVE 2
+#define DEFAULT_CHECKPOINT_KB 4096
+
+typedef struct Wal Wal;
+
+// Opens the hunt's journal, creating it if needed, and replays groups a
+// crash left unapplied; *replayed receives how many. When that is nonzero the
+// caller rebuilds the sidecars and then calls wal_mark_applied. Returns NULL
+// on failure.
+Wal *wal_open(const char *hunt_id, size_t *replayed);
+
+// Journals writes as one group of the given type (WAL_ADD or WAL_REMOVE) and
+// syncs the journal. Returns 0 once the group is durable, or -1 if it is not
+// and must be treated as never written.
+int wal_commit(Wal *wal, uint32_t type, const TreasureWrite *writes, size_t count);
+
+// Applies the writes of the group just committed to treasures.dat. Sidecars
+// that must never count a record the group removes are updated between the
+// two calls, the rest after this one. Returns 0, or -1 if the writes could
+// not be applied (a later wal_open replays them).
+int wal_apply(Wal *wal, const TreasureWrite *writes, size_t count);
+
+// Marks everything journaled so far as applied, once the sidecars reflect
+// it; after a replay on a new boot this checkpoints instead. Returns 0 or -1.
+int wal_mark_applied(Wal *wal);
+
+// Syncs treasures.dat and empties the journal. Returns 0 or -1.
+int wal_checkpoint(Wal *wal);
+
+// Checkpoints if the journal has grown past its limit, then closes it
+void wal_close(Wal *wal);
+
+// Whether the hunt's journal holds groups that wal_open would replay; lets
+// readers under a shared lock decide whether to take the exclusive one
+int wal_pending(const char *hunt_id);
+
+#endif
\ No newline at end of file